@@ -53,7 +53,7 @@ const vector<string> ParseTreeToString::reserved_words = {"COLUMNS", "SHOW", "TA
                                                           "UNNEST", "UPDATE", "UPPER", "USER", "USING", "VALUE",
                                                           "VALUES", "VAR_POP", "VAR_SAMP", "VARCHAR", "VARYING", "WHEN",
                                                           "WHENEVER", "WHERE", "WIDTH_BUCKET", "WINDOW", "WITH",
-                                                          "WITHIN", "WITHOUT", "YEAR"};
+                                                          "WITHIN", "WITHOUT", "YEAR", "VACUUM"};
 
 bool ParseTreeToString::is_reserved_word(string candidate)
 {
@@ -240,6 +240,10 @@ string ParseTreeToString::create(const CreateStatement *stmt)
             doComma = true;
         }
         ret += ")";
+        if (stmt->storageType != nullptr)
+            ret += string(" USING ") + stmt->storageType;
+        if (stmt->pageSize != 0)
+            ret += "(" + to_string(stmt->pageSize) + ")";
     }
     else if (stmt->type == CreateStatement::kIndex)
     {
@@ -301,6 +305,11 @@ string ParseTreeToString::show(const ShowStatement *stmt)
     return ret;
 }
 
+string ParseTreeToString::vacuum(const VacuumStatement *stmt)
+{
+    return string("VACUUM ") + stmt->tableName;
+}
+
 string ParseTreeToString::statement(const SQLStatement *stmt)
 {
     switch (stmt->type())
@@ -315,6 +324,8 @@ string ParseTreeToString::statement(const SQLStatement *stmt)
         return drop((const DropStatement *)stmt);
     case kStmtShow:
         return show((const ShowStatement *)stmt);
+    case kStmtVacuum:
+        return vacuum((const VacuumStatement *)stmt);
 
     case kStmtError:
     case kStmtImport:
@@ -49,4 +49,6 @@ private:
     static std::string drop(const hsql::DropStatement *stmt);
 
     static std::string show(const hsql::ShowStatement *stmt);
+
+    static std::string vacuum(const hsql::VacuumStatement *stmt);
 };
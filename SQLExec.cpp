@@ -4,6 +4,7 @@
  * @see "Seattle University, CPSC5300, Spring 2022"
  */
 #include "SQLExec.h"
+#include <algorithm>
 #include <sstream>
 #include "ParseTreeToString.h"
 
@@ -13,6 +14,7 @@ using namespace hsql;
 // define static data
 Tables *SQLExec::tables = nullptr;
 Indices *SQLExec::indices = nullptr;
+Arena SQLExec::arena;
 
 // make query result be printable
 ostream &operator<<(ostream &out, const QueryResult &qres)
@@ -78,34 +80,109 @@ QueryResult::~QueryResult()
 // The Sqlstatement enter here and analysis to different methods.
 QueryResult *SQLExec::execute(const SQLStatement *statement)
 {
-    // This object is a global variable to store the table
-    // Should need to initiaize the indices
-    if (SQLExec::tables == nullptr)
-    {
-        SQLExec::tables = new Tables();
-        SQLExec::indices = new Indices();
-    }
+    initialize();
 
+    // buffers a statement only needs while it runs come from here and are all dropped together at the end
+    // (the result's rows outlive the statement, so they still come from the heap)
+    ArenaScope scope(SQLExec::arena);
     try
     {
         // There are many types of statements but we just need these three
         // Check StatementType in SQLStatment.h
+        QueryResult *result;
         switch (statement->type())
         {
         case kStmtCreate:
-            return create((const CreateStatement *)statement);
+            result = create((const CreateStatement *)statement);
+            break;
         case kStmtDrop:
-            return drop((const DropStatement *)statement);
+            result = drop((const DropStatement *)statement);
+            break;
         case kStmtShow:
-            return show((const ShowStatement *)statement);
+            result = show((const ShowStatement *)statement);
+            break;
+        case kStmtVacuum:
+            result = vacuum((const VacuumStatement *)statement);
+            break;
         default:
-            return new QueryResult("not implemented");
+            result = new QueryResult("not implemented");
+        }
+        write_back();
+        return result;
+    }
+    catch (DbRelationError &e)
+    {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
+// This object is a global variable to store the table
+// Should need to initiaize the indices
+void SQLExec::initialize()
+{
+    if (SQLExec::tables == nullptr)
+    {
+        SQLExec::tables = new Tables();
+        SQLExec::indices = new Indices();
+    }
+}
+
+// Blocks are cached until written back, so without this a statement's changes (and the catalog rows
+// CREATE TABLE adds) would only reach the files when the program shuts down properly.
+void SQLExec::write_back()
+{
+    Tables::flush_all();
+    SQLExec::indices->flush();
+}
+
+// Nothing has been opened if no statement has run.
+void SQLExec::shutdown()
+{
+    if (SQLExec::tables == nullptr)
+        return;
+    Indices::close_all();
+    Tables::close_all();
+    SQLExec::indices->close();
+}
+
+// Every old handle comes out of an index before any new one goes in, since a row's new handle may be
+// another row's old one.
+QueryResult *SQLExec::vacuum(const VacuumStatement *statement)
+{
+    Identifier table_name = statement->tableName;
+    Relocations *moves = nullptr;
+    try
+    {
+        DbRelation &table = SQLExec::tables->get_table(table_name);
+        moves = table.vacuum();
+        for (auto const &index_name : SQLExec::indices->get_index_names(table_name))
+        {
+            DbIndex &index = SQLExec::indices->get_index(table_name, index_name);
+            for (auto const &move : *moves)
+                index.del(move.first);
+            for (auto const &move : *moves)
+                index.insert(move.second);
         }
+        size_t moved = moves->size();
+        delete moves;
+        return new QueryResult("vacuumed " + table_name + " (" + to_string(moved) + " rows moved)");
+    }
+    catch (SQLExecError &)
+    {
+        delete moves;
+        throw;
     }
     catch (DbRelationError &e)
     {
+        delete moves;
         throw SQLExecError(string("DbRelationError: ") + e.what());
     }
+    catch (std::exception &e)
+    {
+        // the buffer pool, the file or Berkeley DB itself can fail part way through too
+        delete moves;
+        throw SQLExecError(string("vacuum failed: ") + e.what());
+    }
 }
 
 // Check SQLExec.h and ParseTreeToString.h (class ColumnAttribute)
@@ -161,10 +238,18 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement)
         column_attributes.push_back(column_attribute);
     }
 
+    // USING <storage> picks the kind of file the table lives in (default HEAP)
+    string storage = statement->storageType != nullptr ? statement->storageType : "HEAP";
+    transform(storage.begin(), storage.end(), storage.begin(), ::toupper);
+    // USING <storage>(<n>) also picks the page size (default 4kB)
+    int32_t page_size = statement->pageSize != 0 ? (int32_t)statement->pageSize : DbBlock::BLOCK_SZ;
+
     // Execute the statement
     // update _tables schema
     ValueDict row;
     row["table_name"] = table_name;
+    row["storage"] = Value(storage);
+    row["page_size"] = Value(page_size);
     Handle table_handle = SQLExec::tables->insert(&row);
 
     try
@@ -383,22 +468,26 @@ QueryResult *SQLExec::show_tables()
 
     //
     ValueDicts *rows = new ValueDicts();
-    // Select all the rows from table into handles
-    Handles *handles = SQLExec::tables->select();
-    int count = handles->size() - 2;
+    // Walk the rows of the table, decoding each one while its block is pinned
+    DbRelationCursor *cursor = SQLExec::tables->cursor();
+    Handle handle;
 
     // Check not in schema_tables.SCHEMA_TABLES
-    for (auto const &handle : *handles)
+    while (cursor->next(handle))
     {
-        ValueDict *row = SQLExec::tables->project(handle, column_names);
+        ValueDict *row = cursor->project(column_names);
         Identifier table_name = row->at("table_name").s;
         if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME)
         {
             rows->push_back(row);
         }
-        delete row;
+        else
+        {
+            delete row;
+        }
     }
-    delete handles;
+    delete cursor;
+    int count = rows->size();
     return new QueryResult(column_names, column_attributes, rows, " successfully returned " + to_string(count) + " rows");
 }
 
@@ -416,25 +505,13 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement)
     // The middle ColumnAttribute is Class type. The third one is DataType
     column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
 
-    // First ValueDicts to store the data
-    ValueDicts *rows = new ValueDicts();
-
-    // Second ValueDicts to locate the table
+    // ValueDict to locate the table
     ValueDict where;
     where["table_name"] = Value(statement->tableName);
 
-    // A different method to get the column name
-    Handles *handles = SQLExec::tables->get_table(Columns::TABLE_NAME).select(&where);
-    int count = handles->size();
-
-    // Check not in schema_tables.SCHEMA_TABLES
-    for (auto const &handle : *handles)
-    {
-        ValueDict *row = SQLExec::tables->get_table(Columns::TABLE_NAME).project(handle, column_names);
-        rows->push_back(row);
-    }
-
-    delete handles;
+    // Find and decode the table's column rows in one pass
+    ValueDicts *rows = SQLExec::tables->get_table(Columns::TABLE_NAME).scan(&where, column_names);
+    int count = rows->size();
     return new QueryResult(column_names, column_attributes, rows, " successfully returned " + to_string(count) + " rows");
 }
 
@@ -466,16 +543,8 @@ QueryResult *SQLExec::show_index(const ShowStatement *statement)
 
     ValueDict where;
     where["table_name"] = Value(string(statement->tableName));
-    Handles *handles = SQLExec::indices->select(&where);
-    u_long n = handles->size();
-
-    ValueDicts *rows = new ValueDicts;
-    for (auto const &handle : *handles)
-    {
-        ValueDict *row = SQLExec::indices->project(handle, column_names);
-        rows->push_back(row);
-    }
-    delete handles;
+    ValueDicts *rows = SQLExec::indices->scan(&where, column_names);
+    u_long n = rows->size();
     return new QueryResult(column_names, column_attributes, rows,
                            "successfully returned " + to_string(n) + " rows");
 }
@@ -483,7 +552,7 @@ QueryResult *SQLExec::show_index(const ShowStatement *statement)
 // Test Function for SQLExec class
 bool test_sqlexec_table()
 {
-    const int num_queries = 11;
+    const int num_queries = 12;
     const string queries[num_queries] = {"show tables",
                                          "show columns from _tables",
                                          "show columns from _columns",
@@ -492,18 +561,20 @@ bool test_sqlexec_table()
                                          "create table goo (x int, x text)",
                                          "show tables",
                                          "show columns from foo",
+                                         "vacuum foo",
                                          "drop table foo",
                                          "show tables",
                                          "show columns from foo"};
     bool passed = true;
     const string results[num_queries] = {"SHOW TABLES table_name  successfully returned 0 rows",
-                                         "SHOW COLUMNS FROM _tables table_name column_name data_type _tables table_name TEXT successfully returned 1 rows",
+                                         "SHOW COLUMNS FROM _tables table_name column_name data_type _tables table_name TEXT _tables storage TEXT _tables page_size INT successfully returned 3 rows",
                                          "SHOW COLUMNS FROM _columns   table_name column_name data_type _columns   table_name TEXT_columns column_name  TEXT_columns data_type TEXT   successfully returned 3 rows",
                                          "CREATE TABLE foo (id INT, data TEXT, x INT, y INT, z INT)  created foo",
                                          "CREATE TABLE foo (goober INT)  Error: DbRelationError: foo already exists",
                                          "Error: DbRelationError: duplicate column goo.x",
                                          "SHOW TABLES  table_name foo successfully returned 1 rows",
                                          "SHOW COLUMNS FROM foo  table_name column_name data_type foo id INT foo data TEXT  foo x INT  foo y INT  foo z INT  successfully returned 5 rows",
+                                         "VACUUM foo  vacuumed foo (0 rows moved)",
                                          "DROP TABLE foo   dropped foo",
                                          "SHOW TABLES  table_name  successfully returned 0 rows",
                                          "SHOW COLUMNS FROM footable_name column_name data_type  successfully returned 0 rows"};
@@ -8,6 +8,7 @@
 #include <exception>
 #include <string>
 #include "SQLParser.h"
+#include "arena.h"
 #include "schema_tables.h"
 
 /**
@@ -65,11 +66,26 @@ public:
      */
     static QueryResult *execute(const hsql::SQLStatement *statement);
 
+    /**
+     * Close every table and index we have opened, writing back anything still cached.
+     * Call before the program exits.
+     */
+    static void shutdown();
+
 protected:
     // the one place in the system that holds the _tables and _indices tables
     static Tables *tables;
     static Indices *indices;
 
+    // scratch memory for the statement being executed, emptied when it finishes
+    static Arena arena;
+
+    // make the schema tables the first time they are needed
+    static void initialize();
+
+    // write back what a statement has changed
+    static void write_back();
+
     // recursive decent into the AST
     static QueryResult *create(const hsql::CreateStatement *statement);
 
@@ -91,6 +107,9 @@ protected:
 
     static QueryResult *show_index(const hsql::ShowStatement *statement);
 
+    // VACUUM <table_name>: pack the table's rows into as few blocks as possible and fix up its indices
+    static QueryResult *vacuum(const hsql::VacuumStatement *statement);
+
     /**
      * Pull out column name and attributes from AST's column definition clause
      * @param col                AST column definition
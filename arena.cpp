@@ -0,0 +1,91 @@
+/**
+ * @file arena.cpp - Implementation of Arena and ScratchBuffer.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "arena.h"
+#include <algorithm>
+
+const size_t Arena::CHUNK_SZ;
+thread_local Arena *Arena::active = nullptr;
+
+// every allocation starts on a boundary good for any type
+static const size_t ALIGN = alignof(std::max_align_t);
+
+static size_t round_up(size_t size)
+{
+    return (size + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+Arena::~Arena()
+{
+    for (auto chunk : this->chunks)
+        delete[] chunk;
+}
+
+// Start a new chunk when the current one can't hold the request.
+void *Arena::allocate(size_t size)
+{
+    size = round_up(std::max(size, (size_t)1));
+    if (this->chunks.empty() || this->top + size > this->sizes.back())
+    {
+        size_t chunk_sz = std::max(size, CHUNK_SZ);
+        this->chunks.push_back(new char[chunk_sz]);
+        this->sizes.push_back(chunk_sz);
+        this->top = 0;
+    }
+    void *p = this->chunks.back() + this->top;
+    this->top += size;
+    this->used += size;
+    return p;
+}
+
+// Rewind if p was the last thing handed out; anything else waits for reset().
+void Arena::free(void *p, size_t size)
+{
+    size = round_up(std::max(size, (size_t)1));
+    if (!this->chunks.empty() && this->top >= size && p == this->chunks.back() + this->top - size)
+    {
+        this->top -= size;
+        this->used -= size;
+    }
+}
+
+// Keep the first chunk for next time and return the rest to the heap.
+void Arena::reset()
+{
+    while (this->chunks.size() > 1)
+    {
+        delete[] this->chunks.back();
+        this->chunks.pop_back();
+        this->sizes.pop_back();
+    }
+    this->top = 0;
+    this->used = 0;
+}
+
+Arena *Arena::current()
+{
+    return active;
+}
+
+/**
+ * @class ScratchBuffer - bytes needed only until the end of a block of code
+ */
+
+ScratchBuffer::ScratchBuffer(size_t size) : arena(Arena::current()), size(size)
+{
+    if (this->arena != nullptr)
+        this->bytes = (char *)this->arena->allocate(size);
+    else
+        this->bytes = new char[size];
+}
+
+ScratchBuffer::~ScratchBuffer()
+{
+    if (this->arena != nullptr)
+        this->arena->free(this->bytes, this->size);
+    else
+        delete[] this->bytes;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file arena.h - Per-statement memory for short-lived buffers.
+ * Arena
+ * ArenaScope
+ * ScratchBuffer
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class Arena - monotonic allocator, emptied all at once
+ *
+ *      Memory is carved off the end of large chunks and never handed back one piece at a time;
+        reset() gives it all back at the end of a statement. The first chunk is kept across
+        resets, so a statement that fits in it makes no calls to the heap at all. Freeing the most
+        recent allocation rewinds the arena, which keeps buffers taken and dropped in a loop from
+        piling up.
+ */
+class Arena
+{
+public:
+    /**
+     * bytes in each chunk (bigger requests get a chunk of their own)
+     */
+    static const size_t CHUNK_SZ = 256 * 1024;
+
+    Arena() : top(0), used(0) {}
+
+    virtual ~Arena();
+
+    Arena(const Arena &other) = delete;
+
+    Arena(Arena &&temp) = delete;
+
+    Arena &operator=(const Arena &other) = delete;
+
+    Arena &operator=(Arena &&temp) = delete;
+
+    /**
+     * Carve size bytes, aligned for any type, off the current chunk.
+     * @param size  bytes wanted
+     * @returns     the memory (good until reset())
+     */
+    void *allocate(size_t size);
+
+    /**
+     * Give back memory from allocate(). Only the most recent allocation is actually reused.
+     */
+    void free(void *p, size_t size);
+
+    /**
+     * Give back everything allocated since the last reset().
+     */
+    void reset();
+
+    /**
+     * Bytes handed out (and not rewound) since the last reset().
+     */
+    size_t get_used() const { return used; }
+
+    /**
+     * The arena of the statement running on this thread, or nullptr if there is none.
+     */
+    static Arena *current();
+
+protected:
+    friend class ArenaScope;
+
+    std::vector<char *> chunks;
+    std::vector<size_t> sizes; // of each chunk
+    size_t top;                // next free byte in chunks.back()
+    size_t used;
+
+    static thread_local Arena *active;
+};
+
+/**
+ * @class ArenaScope - makes an arena current for the life of the scope, then resets it
+ */
+class ArenaScope
+{
+public:
+    ArenaScope(Arena &arena) : arena(arena), outer(Arena::active) { Arena::active = &arena; }
+
+    ~ArenaScope()
+    {
+        Arena::active = this->outer;
+        this->arena.reset();
+    }
+
+    ArenaScope(const ArenaScope &other) = delete;
+
+    ArenaScope &operator=(const ArenaScope &other) = delete;
+
+protected:
+    Arena &arena;
+    Arena *outer;
+};
+
+/**
+ * @class ScratchBuffer - bytes needed only until the end of a block of code
+ *
+ * Taken from the current arena if a statement is running, otherwise from the heap.
+ */
+class ScratchBuffer
+{
+public:
+    ScratchBuffer(size_t size);
+
+    ~ScratchBuffer();
+
+    ScratchBuffer(const ScratchBuffer &other) = delete;
+
+    ScratchBuffer &operator=(const ScratchBuffer &other) = delete;
+
+    char *data() { return bytes; }
+
+protected:
+    Arena *arena;
+    char *bytes;
+    size_t size;
+};
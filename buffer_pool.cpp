@@ -0,0 +1,178 @@
+/**
+ * @file buffer_pool.cpp - Implementation of BufferPool.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "buffer_pool.h"
+#include <cstring>
+#include <string>
+
+BufferPool::BufferPool(Db &db, uint capacity, uint block_sz) : db(db), capacity(capacity), block_sz(block_sz),
+                                                                clock_hand(0), hits(0), misses(0) {}
+
+// Frames are not written back here; the owning file flushes before it goes away.
+BufferPool::~BufferPool()
+{
+    for (auto frame : frames)
+        delete frame;
+}
+
+// Pin a block, reading it from the file on a miss.
+BufferFrame *BufferPool::pin(BlockID block_id)
+{
+    auto it = lookup.find(block_id);
+    if (it != lookup.end())
+    {
+        hits++;
+        BufferFrame *frame = it->second;
+        frame->pin_count++;
+        frame->referenced = true;
+        return frame;
+    }
+
+    misses++;
+    BufferFrame *frame = victim();
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(frame->data, block_sz);
+    data.set_ulen(block_sz);
+    data.set_flags(DB_DBT_USERMEM);
+    if (db.get(nullptr, &key, &data, 0) == DB_NOTFOUND)
+    {
+        frame->block_id = 0; // leave it as a free frame
+        frame->dirty = false;
+        frame->referenced = false;
+        throw BufferPoolError("block " + std::to_string(block_id) + " not found");
+    }
+    frame->block_id = block_id;
+    frame->pin_count = 1;
+    frame->referenced = true;
+    lookup[block_id] = frame;
+    return frame;
+}
+
+// Pin a fresh, zeroed frame for a block that has not been read from the file.
+BufferFrame *BufferPool::pin_new(BlockID block_id)
+{
+    auto it = lookup.find(block_id);
+    BufferFrame *frame = it != lookup.end() ? it->second : victim();
+    if (frame->page != nullptr)
+    {
+        delete frame->page;
+        frame->page = nullptr;
+    }
+    memset(frame->data, 0, block_sz);
+    frame->block_id = block_id;
+    frame->pin_count++;
+    frame->dirty = true;
+    frame->referenced = true;
+    lookup[block_id] = frame;
+    return frame;
+}
+
+// Unpin a block. It stays cached until the clock chooses it as a victim.
+void BufferPool::unpin(BlockID block_id)
+{
+    auto it = lookup.find(block_id);
+    if (it != lookup.end() && it->second->pin_count > 0)
+        it->second->pin_count--;
+}
+
+// Note that a cached block needs to be written back.
+bool BufferPool::mark_dirty(BlockID block_id)
+{
+    auto it = lookup.find(block_id);
+    if (it == lookup.end())
+        return false;
+    it->second->dirty = true;
+    return true;
+}
+
+// Write all the dirty blocks back to the file.
+void BufferPool::flush()
+{
+    for (auto frame : frames)
+        if (frame->dirty)
+            write(frame);
+}
+
+// Drop every frame, optionally writing dirty blocks back first.
+void BufferPool::reset(bool write_back)
+{
+    if (write_back)
+        flush();
+    for (auto frame : frames)
+        delete frame;
+    frames.clear();
+    lookup.clear();
+    clock_hand = 0;
+}
+
+// The frames stay in the pool, free for victim() to hand out again.
+void BufferPool::discard(BlockID last)
+{
+    for (auto frame : frames)
+    {
+        if (frame->block_id <= last)
+            continue;
+        lookup.erase(frame->block_id);
+        delete frame->page;
+        frame->page = nullptr;
+        frame->block_id = 0;
+        frame->pin_count = 0;
+        frame->dirty = false;
+        frame->referenced = false;
+    }
+}
+
+// Frames are sized for the file's blocks, so this is only changed once the file tells us its block size.
+void BufferPool::set_block_size(uint block_sz)
+{
+    if (block_sz == this->block_sz)
+        return;
+    reset(true);
+    this->block_sz = block_sz;
+}
+
+// Find an unpinned frame to reuse: grow the pool until it reaches capacity, then sweep with CLOCK.
+// The returned frame is no longer in the lookup table and holds no page.
+BufferFrame *BufferPool::victim()
+{
+    if (frames.size() < capacity)
+    {
+        BufferFrame *frame = new BufferFrame(block_sz);
+        frames.push_back(frame);
+        return frame;
+    }
+
+    // two full sweeps: the first may only clear reference bits
+    for (uint i = 0; i < 2 * frames.size(); i++)
+    {
+        BufferFrame *frame = frames[clock_hand];
+        clock_hand = (clock_hand + 1) % frames.size();
+        if (frame->pin_count > 0)
+            continue;
+        if (frame->referenced)
+        {
+            frame->referenced = false;
+            continue;
+        }
+        if (frame->dirty)
+            write(frame);
+        lookup.erase(frame->block_id);
+        delete frame->page;
+        frame->page = nullptr;
+        return frame;
+    }
+    throw BufferPoolError("all buffer frames are pinned");
+}
+
+// Write a frame's block back to the file.
+void BufferPool::write(BufferFrame *frame)
+{
+    BlockID block_id = frame->block_id;
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(frame->data, block_sz);
+    db.put(nullptr, &key, &data, 0);
+    frame->dirty = false;
+}
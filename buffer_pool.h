@@ -0,0 +1,163 @@
+/**
+ * @file buffer_pool.h - Page cache that sits between a DbFile and Berkeley DB.
+ * BufferFrame
+ * BufferPool
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class BufferPoolError - exception for BufferPool methods
+ */
+class BufferPoolError : public std::runtime_error
+{
+public:
+    explicit BufferPoolError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class BufferFrame - one block-sized slot of a BufferPool
+ *
+ * The frame owns the block's bytes and, once the owning file has wrapped them,
+ * the DbBlock object managing those bytes. Both live as long as the block stays
+ * in the pool, so repeated fetches of a hot block hand back the same object.
+ */
+class BufferFrame
+{
+public:
+    BufferFrame(uint block_sz) : block_id(0), data(new char[block_sz]), dbt(data, block_sz), page(nullptr),
+                                 pin_count(0), dirty(false), referenced(false) {}
+
+    ~BufferFrame()
+    {
+        delete page;
+        delete[] data;
+    }
+
+    BufferFrame(const BufferFrame &other) = delete;
+
+    BufferFrame(BufferFrame &&temp) = delete;
+
+    BufferFrame &operator=(const BufferFrame &other) = delete;
+
+    BufferFrame &operator=(BufferFrame &&temp) = delete;
+
+    BlockID block_id;
+    char *data;
+    Dbt dbt;       // wraps data for the DbBlock constructor
+    DbBlock *page; // owned by the frame, set by the file on first fetch
+    uint pin_count;
+    bool dirty;
+    bool referenced; // second-chance bit for the CLOCK sweep
+};
+
+/**
+ * @class BufferPool - fixed number of frames caching the blocks of one Berkeley DB RecNo file
+ *
+ *      Blocks are pinned while in use and may not be evicted until unpinned.
+        Victims are chosen with the CLOCK algorithm. Dirty blocks are written back
+        when they are evicted or when the pool is flushed (on close of the file).
+ */
+class BufferPool
+{
+public:
+    /**
+     * default number of frames per pool
+     */
+    static const uint DEFAULT_CAPACITY = 64;
+
+    BufferPool(Db &db, uint capacity = DEFAULT_CAPACITY, uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~BufferPool();
+
+    BufferPool(const BufferPool &other) = delete;
+
+    BufferPool(BufferPool &&temp) = delete;
+
+    BufferPool &operator=(const BufferPool &other) = delete;
+
+    BufferPool &operator=(BufferPool &&temp) = delete;
+
+    /**
+     * Pin a block, reading it from the file if it is not already cached.
+     * @param block_id  which block to pin
+     * @returns         the frame holding the block
+     * @throws          BufferPoolError if every frame is pinned
+     */
+    virtual BufferFrame *pin(BlockID block_id);
+
+    /**
+     * Pin a frame for a block that is not yet in the file. Its bytes are zeroed
+     * and nothing is read.
+     * @param block_id  which block to pin
+     * @returns         the frame holding the block
+     * @throws          BufferPoolError if every frame is pinned
+     */
+    virtual BufferFrame *pin_new(BlockID block_id);
+
+    /**
+     * Unpin a block pinned by pin() or pin_new().
+     * @param block_id  which block to unpin
+     */
+    virtual void unpin(BlockID block_id);
+
+    /**
+     * Note that a cached block has been changed and must be written back.
+     * @param block_id  which block has changed
+     * @returns         false if the block is not in the pool
+     */
+    virtual bool mark_dirty(BlockID block_id);
+
+    /**
+     * Write every dirty block back to the file.
+     */
+    virtual void flush();
+
+    /**
+     * Empty the pool. All frames are released; pins held by callers become invalid.
+     * @param write_back  flush dirty blocks first (false when the file is being removed)
+     */
+    virtual void reset(bool write_back = true);
+
+    /**
+     * Forget the blocks after last without writing them back (the file is being cut short).
+     * They must not be pinned.
+     * @param last  last block id to keep
+     */
+    virtual void discard(BlockID last);
+
+    /**
+     * Change the size of the frames. The pool is emptied (with write-back) first.
+     * @param block_sz  size of the file's blocks in bytes
+     */
+    virtual void set_block_size(uint block_sz);
+
+    /**
+     * Accessors for the hit/miss counters.
+     */
+    virtual u_long get_hits() const { return hits; }
+
+    virtual u_long get_misses() const { return misses; }
+
+protected:
+    Db &db;
+    uint capacity;
+    uint block_sz;
+    std::vector<BufferFrame *> frames;
+    std::unordered_map<BlockID, BufferFrame *> lookup;
+    uint clock_hand;
+    u_long hits;
+    u_long misses;
+
+    virtual BufferFrame *victim();
+
+    virtual void write(BufferFrame *frame);
+};
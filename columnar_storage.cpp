@@ -0,0 +1,486 @@
+/**
+ * @file columnar_storage.cpp - Implementation of ColumnarTable and ColumnarTableCursor.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "columnar_storage.h"
+#include "arena.h"
+#include <cstring>
+#include <iostream>
+
+typedef u_int16_t u16;
+
+/**
+ * @class ColumnarTable - column store
+ */
+
+// ColumnarTable constructor
+ColumnarTable::ColumnarTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                             uint block_sz) : DbRelation(table_name, column_names, column_attributes)
+{
+    for (auto const &column_name : this->column_names)
+        this->files.push_back(new HeapFile(table_name + "." + column_name, block_sz));
+}
+
+ColumnarTable::~ColumnarTable()
+{
+    for (auto file : this->files)
+        delete file;
+}
+
+// Execute: CREATE TABLE <table_name> ( <columns> ) USING COLUMNAR
+void ColumnarTable::create()
+{
+    for (auto file : this->files)
+        file->create();
+}
+
+// Execute: CREATE TABLE IF NOT EXISTS <table_name> ( <columns> ) USING COLUMNAR
+void ColumnarTable::create_if_not_exists()
+{
+    try
+    {
+        open();
+    }
+    catch (DbException &e)
+    {
+        close();
+        create();
+    }
+}
+
+// Execute: DROP TABLE <table_name>
+void ColumnarTable::drop()
+{
+    for (auto file : this->files)
+        file->drop();
+}
+
+// Open existing table. Enables: insert, update, delete, select, project
+void ColumnarTable::open()
+{
+    for (auto file : this->files)
+        file->open();
+}
+
+// Closes the table. Disables: insert, update, delete, select, project
+void ColumnarTable::close()
+{
+    for (auto file : this->files)
+        file->close();
+}
+
+// Write back every column's file; the table stays open.
+void ColumnarTable::flush()
+{
+    for (auto file : this->files)
+        file->flush();
+}
+
+// Add each column's value to the last block of its file, or to a new block in every file
+// if any of them is out of room.
+Handle ColumnarTable::insert(const ValueDict *row)
+{
+    open();
+    uint num_columns = this->column_names.size();
+    std::vector<u_int32_t> offsets(num_columns + 1, 0);
+    ScratchBuffer buffer(num_columns * this->files[0]->get_block_size());
+    char *bytes = buffer.data();
+    std::vector<DbBlock *> blocks;
+    try
+    {
+        for (uint col_num = 0; col_num < num_columns; col_num++)
+        {
+            ValueDict::const_iterator it = row->find(this->column_names[col_num]);
+            if (it == row->end())
+                throw DbRelationError("don't know how to handle NULLs, defaults, etc.");
+            offsets[col_num + 1] = offsets[col_num] + marshal(col_num, it->second, bytes + offsets[col_num]);
+        }
+
+        bool room = true;
+        for (uint col_num = 0; col_num < num_columns; col_num++)
+        {
+            HeapFile *file = this->files[col_num];
+            blocks.push_back(file->get(file->get_last_block_id()));
+            room = room && blocks.back()->get_free_space() >= offsets[col_num + 1] - offsets[col_num];
+        }
+        if (!room)
+        {
+            for (uint col_num = 0; col_num < num_columns; col_num++)
+            {
+                this->files[col_num]->release(blocks[col_num]);
+                blocks[col_num] = this->files[col_num]->get_new();
+            }
+            for (uint col_num = 0; col_num < num_columns; col_num++)
+                if (blocks[col_num]->get_free_space() < offsets[col_num + 1] - offsets[col_num])
+                    throw DbBlockNoRoomError("not enough room for new record"); // doesn't even fit in an empty block
+        }
+
+        RecordID record_id = 0;
+        for (uint col_num = 0; col_num < num_columns; col_num++)
+        {
+            Dbt data(bytes + offsets[col_num], offsets[col_num + 1] - offsets[col_num]);
+            RecordID added = blocks[col_num]->add(&data);
+            if (col_num > 0 && added != record_id)
+                throw DbRelationError(this->table_name + " columns are out of step");
+            record_id = added;
+            this->files[col_num]->put(blocks[col_num]);
+            this->files[col_num]->rows_changed(1);
+        }
+        Handle handle(blocks[0]->get_block_id(), record_id);
+        for (uint col_num = 0; col_num < num_columns; col_num++)
+            this->files[col_num]->release(blocks[col_num]);
+        return handle;
+    }
+    catch (...)
+    {
+        for (uint col_num = 0; col_num < blocks.size(); col_num++)
+            this->files[col_num]->release(blocks[col_num]);
+        throw;
+    }
+}
+
+// Not supported yet, same as HeapTable.
+void ColumnarTable::update(const Handle handle, const ValueDict *new_values)
+{
+    throw DbRelationError("Not implemented");
+}
+
+// Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
+// The row goes from every column's file, so the files stay in step.
+void ColumnarTable::del(const Handle handle)
+{
+    open();
+    for (auto file : this->files)
+    {
+        DbBlock *block = file->get(handle.first);
+        RecordView record;
+        if (block->view(handle.second, record))
+        {
+            block->del(handle.second);
+            file->put(block);
+            file->rows_changed(-1);
+        }
+        file->release(block);
+    }
+}
+
+// Conceptually, execute: SELECT <handle> FROM <table_name>
+Handles *ColumnarTable::select()
+{
+    return select(nullptr);
+}
+
+// Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+Handles *ColumnarTable::select(const ValueDict *where)
+{
+    Handles *handles = new Handles();
+    ColumnarTableCursor cursor(*this, where);
+    Handle handle;
+    while (cursor.next(handle))
+        handles->push_back(handle);
+    return handles;
+}
+
+// Same as select(where), but the handles are found one at a time as the caller asks for them.
+DbRelationCursor *ColumnarTable::cursor(const ValueDict *where)
+{
+    return new ColumnarTableCursor(*this, where);
+}
+
+// Return all values for handle.
+ValueDict *ColumnarTable::project(Handle handle)
+{
+    return project(handle, &this->column_names);
+}
+
+// Return the values for handle given by column_names, reading only those columns' files.
+ValueDict *ColumnarTable::project(Handle handle, const ColumnNames *column_names)
+{
+    if (column_names->empty())
+        return project(handle);
+    ValueDict *row = new ValueDict();
+    for (auto const &column_name : *column_names)
+    {
+        uint col_num = column_number(column_name);
+        HeapFile *file = this->files[col_num];
+        DbBlock *block = file->get(handle.first);
+        RecordView record;
+        if (!block->view(handle.second, record))
+        {
+            file->release(block);
+            delete row;
+            throw DbRelationError("record has been deleted");
+        }
+        (*row)[column_name] = unmarshal(col_num, record);
+        file->release(block);
+    }
+    return row;
+}
+
+// Position of column_name in our columns.
+uint ColumnarTable::column_number(const Identifier &column_name)
+{
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+        if (this->column_names[col_num] == column_name)
+            return col_num;
+    throw DbRelationError("unknown column " + column_name);
+}
+
+// One column's value, laid out just as HeapTable::marshal() lays it out within a row.
+u_int32_t ColumnarTable::marshal(uint col_num, const Value &value, char *bytes)
+{
+    switch (this->column_attributes[col_num].get_data_type())
+    {
+    case ColumnAttribute::DataType::INT:
+        *(int32_t *)bytes = value.n;
+        return sizeof(int32_t);
+    case ColumnAttribute::DataType::TEXT:
+    {
+        u16 size = value.s.length();
+        *(u16 *)bytes = size;
+        memcpy(bytes + sizeof(u16), value.s.c_str(), size); // assume ascii for now
+        return sizeof(u16) + size;
+    }
+    case ColumnAttribute::DataType::BOOLEAN:
+        *(u_int8_t *)bytes = value.n != 0;
+        return sizeof(u_int8_t);
+    default:
+        throw DbRelationError("Only know how to marshal INT, TEXT and BOOLEAN");
+    }
+}
+
+// Decode one column's value.
+Value ColumnarTable::unmarshal(uint col_num, const RecordView &record)
+{
+    Value value;
+    switch (this->column_attributes[col_num].get_data_type())
+    {
+    case ColumnAttribute::DataType::INT:
+        value.n = *(int32_t *)record.data;
+        break;
+    case ColumnAttribute::DataType::TEXT:
+        value.data_type = ColumnAttribute::TEXT;
+        value.s.assign(record.data + sizeof(u16), *(u16 *)record.data);
+        break;
+    case ColumnAttribute::DataType::BOOLEAN:
+        value.data_type = ColumnAttribute::BOOLEAN;
+        value.n = *(u_int8_t *)record.data;
+        break;
+    default:
+        throw DbRelationError("Only know how to unmarshal INT, TEXT and BOOLEAN");
+    }
+    return value;
+}
+
+// Check one column's marshaled value against a where-clause value without decoding it.
+bool ColumnarTable::matches(uint col_num, const RecordView &record, const Value &value)
+{
+    switch (this->column_attributes[col_num].get_data_type())
+    {
+    case ColumnAttribute::DataType::INT:
+        return *(int32_t *)record.data == value.n;
+    case ColumnAttribute::DataType::TEXT:
+    {
+        u16 size = *(u16 *)record.data;
+        return size == value.s.length() && memcmp(record.data + sizeof(u16), value.s.data(), size) == 0;
+    }
+    case ColumnAttribute::DataType::BOOLEAN:
+        return *(u_int8_t *)record.data == (value.n != 0);
+    default:
+        throw DbRelationError("Only know how to compare INT, TEXT and BOOLEAN");
+    }
+}
+
+/**
+ * @class ColumnarTableCursor - scan of a ColumnarTable
+ */
+
+ColumnarTableCursor::ColumnarTableCursor(ColumnarTable &table, const ValueDict *where) : table(table), driver(0),
+                                                                                        blocks(table.files.size(), nullptr),
+                                                                                        block_id(0), record_id(0)
+{
+    if (where != nullptr)
+        for (auto const &column : *where)
+        {
+            uint col_num = table.column_number(column.first);
+            bool text_column = table.column_attributes[col_num].get_data_type() == ColumnAttribute::DataType::TEXT;
+            if (text_column != (column.second.data_type == ColumnAttribute::DataType::TEXT))
+                throw DbRelationError("wrong type in where clause for column " + column.first);
+            this->predicates.push_back(std::make_pair(col_num, &column.second));
+        }
+    if (!this->predicates.empty())
+        this->driver = this->predicates[0].first;
+}
+
+// Unpin whatever blocks we stopped in.
+ColumnarTableCursor::~ColumnarTableCursor()
+{
+    release();
+}
+
+// Move to the next row whose predicate columns match, stepping into the next block when this one runs out.
+bool ColumnarTableCursor::next(Handle &handle)
+{
+    while (true)
+    {
+        DbBlock *driving = this->blocks[this->driver];
+        while (driving != nullptr && driving->next_id(this->record_id))
+        {
+            bool selected = true;
+            for (auto const &predicate : this->predicates)
+            {
+                RecordView record;
+                if (!block(predicate.first)->view(this->record_id, record) ||
+                    !this->table.matches(predicate.first, record, *predicate.second))
+                {
+                    selected = false;
+                    break;
+                }
+            }
+            if (selected)
+            {
+                handle = Handle(this->block_id, this->record_id);
+                return true;
+            }
+        }
+        release();
+        if (!this->table.files[this->driver]->next_block_id(this->block_id))
+            return false;
+        this->record_id = 0;
+        block(this->driver);
+    }
+}
+
+// Decode the asked-for columns of the current row, pinning their blocks if they are not yet.
+ValueDict *ColumnarTableCursor::project(const ColumnNames *column_names)
+{
+    if (this->blocks[this->driver] == nullptr)
+        throw DbRelationError("cursor is not on a row");
+    if (column_names == nullptr || column_names->empty())
+        column_names = &this->table.column_names;
+    ValueDict *row = new ValueDict();
+    for (auto const &column_name : *column_names)
+    {
+        uint col_num = this->table.column_number(column_name);
+        RecordView record;
+        if (!block(col_num)->view(this->record_id, record))
+        {
+            delete row;
+            throw DbRelationError("cursor is not on a row");
+        }
+        (*row)[column_name] = this->table.unmarshal(col_num, record);
+    }
+    return row;
+}
+
+// Decode every column of the current row, pinning their blocks if they are not yet.
+void ColumnarTableCursor::project(Row &row)
+{
+    if (this->blocks[this->driver] == nullptr)
+        throw DbRelationError("cursor is not on a row");
+    if (!row.fits(this->table.column_attributes))
+        row.bind(this->table.column_attributes);
+    row.clear_text();
+    for (uint col_num = 0; col_num < this->blocks.size(); col_num++)
+    {
+        RecordView record;
+        if (!block(col_num)->view(this->record_id, record))
+            throw DbRelationError("cursor is not on a row");
+        switch (row.get_data_type(col_num))
+        {
+        case ColumnAttribute::DataType::TEXT:
+            row.set_text(col_num, record.data + sizeof(u16), *(u16 *)record.data);
+            break;
+        case ColumnAttribute::DataType::BOOLEAN:
+            row.set_boolean(col_num, *(u_int8_t *)record.data);
+            break;
+        default:
+            row.set_int(col_num, *(int32_t *)record.data);
+        }
+    }
+}
+
+// The current block of a column, pinned on first use.
+DbBlock *ColumnarTableCursor::block(uint col_num)
+{
+    if (this->blocks[col_num] == nullptr)
+        this->blocks[col_num] = this->table.files[col_num]->get(this->block_id);
+    return this->blocks[col_num];
+}
+
+// Unpin the current block of every column.
+void ColumnarTableCursor::release()
+{
+    for (uint col_num = 0; col_num < this->blocks.size(); col_num++)
+    {
+        if (this->blocks[col_num] != nullptr)
+        {
+            this->table.files[col_num]->release(this->blocks[col_num]);
+            this->blocks[col_num] = nullptr;
+        }
+    }
+}
+
+// test function -- returns true if all tests pass
+bool test_columnar_storage()
+{
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    ColumnarTable table("_test_columnar_cpp", column_names, column_attributes);
+    table.create();
+
+    // enough rows that the short column runs out of room in a block before the long one
+    ValueDict row;
+    Handle handle;
+    for (int i = 0; i < 1000; i++)
+    {
+        row["a"] = Value(i);
+        row["b"] = Value(i % 100 == 0 ? std::string(200, 'x') : "short");
+        handle = table.insert(&row);
+    }
+    table.del(Handle(1, 2));
+
+    ValueDict where;
+    where["b"] = Value(std::string(200, 'x'));
+    Handles *handles = table.select(&where);
+    bool ok = handles->size() == 10;
+    ColumnNames just_a;
+    just_a.push_back("a");
+    for (uint i = 0; ok && i < handles->size(); i++)
+    {
+        ValueDict *result = table.project(handles->at(i), &just_a);
+        ok = result->size() == 1 && (*result)["a"].n == (int)i * 100;
+        delete result;
+    }
+    delete handles;
+
+    handles = table.select();
+    ok = ok && handles->size() == 999 && handles->back() == handle;
+    delete handles;
+    ValueDict *result = table.project(handle);
+    ok = ok && (*result)["a"].n == 999 && (*result)["b"].s == "short";
+    delete result;
+    where.clear();
+    where["a"] = Value("999");
+    try
+    {
+        delete table.select(&where);
+        ok = false;
+    }
+    catch (DbRelationError &e)
+    {
+    }
+    table.drop();
+    if (!ok)
+    {
+        std::cout << "Wrong columnar table rows" << std::endl;
+        return false;
+    }
+    return true;
+}
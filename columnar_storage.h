@@ -0,0 +1,126 @@
+/**
+ * @file columnar_storage.h - Column-at-a-time storage engine.
+ * ColumnarTable: DbRelation
+ * ColumnarTableCursor: DbRelationCursor
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * @class ColumnarTable - column store (implementation of DbRelation)
+ *
+ *      Each column is kept in its own HeapFile, <table>.<column>.db, holding one record per row
+        with just that column's value. The files are kept in step: a row is added to the same block
+        of every file and so gets the same record id in each, which makes the (block id, record id)
+        handle good for every column. When any column's block is full, every file gets a new block.
+        Reading a row only touches the files of the columns asked for.
+ */
+class ColumnarTable : public DbRelation
+{
+    friend class ColumnarTableCursor;
+
+public:
+    ColumnarTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                  uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~ColumnarTable();
+
+    ColumnarTable(const ColumnarTable &other) = delete;
+
+    ColumnarTable(ColumnarTable &&temp) = delete;
+
+    ColumnarTable &operator=(const ColumnarTable &other) = delete;
+
+    ColumnarTable &operator=(ColumnarTable &&temp) = delete;
+
+    virtual void create();
+
+    virtual void create_if_not_exists();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    virtual void flush();
+
+    virtual Handle insert(const ValueDict *row);
+
+    virtual void update(const Handle handle, const ValueDict *new_values);
+
+    virtual void del(const Handle handle);
+
+    virtual Handles *select();
+
+    virtual Handles *select(const ValueDict *where);
+
+    virtual DbRelationCursor *cursor(const ValueDict *where = nullptr);
+
+    virtual ValueDict *project(Handle handle);
+
+    virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
+
+    using DbRelation::insert;
+
+    using DbRelation::project;
+
+    using DbRelation::select;
+
+protected:
+    std::vector<HeapFile *> files; // one per column, in column order
+
+    virtual uint column_number(const Identifier &column_name);
+
+    virtual u_int32_t marshal(uint col_num, const Value &value, char *bytes);
+
+    virtual Value unmarshal(uint col_num, const RecordView &record);
+
+    virtual bool matches(uint col_num, const RecordView &record, const Value &value);
+};
+
+/**
+ * @class ColumnarTableCursor - scan of a ColumnarTable (implementation of DbRelationCursor)
+ *
+ * Walks the blocks of one column (the first one in the where clause, if any) and pins the same
+ * block of other columns only when a predicate or project() needs them.
+ */
+class ColumnarTableCursor : public DbRelationCursor
+{
+public:
+    ColumnarTableCursor(ColumnarTable &table, const ValueDict *where = nullptr);
+
+    virtual ~ColumnarTableCursor();
+
+    ColumnarTableCursor(const ColumnarTableCursor &other) = delete;
+
+    ColumnarTableCursor(ColumnarTableCursor &&temp) = delete;
+
+    ColumnarTableCursor &operator=(const ColumnarTableCursor &other) = delete;
+
+    ColumnarTableCursor &operator=(ColumnarTableCursor &&temp) = delete;
+
+    virtual bool next(Handle &handle);
+
+    virtual ValueDict *project(const ColumnNames *column_names = nullptr);
+
+    virtual void project(Row &row);
+
+protected:
+    ColumnarTable &table;
+    std::vector<std::pair<uint, const Value *>> predicates; // (column number, value it must equal)
+    uint driver;                                            // column whose record ids we walk
+    std::vector<DbBlock *> blocks;                          // pinned block of each column, or nullptr
+    BlockID block_id;
+    RecordID record_id;
+
+    virtual DbBlock *block(uint col_num);
+
+    virtual void release();
+};
+
+bool test_columnar_storage();
@@ -0,0 +1,273 @@
+/**
+ * @file fixed_heap_storage.cpp - Implementation of FixedPage, FixedHeapFile and FixedHeapTable.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "fixed_heap_storage.h"
+#include <cstring>
+#include <iostream>
+
+typedef u_int16_t u16;
+
+static const u16 FIXED_HEADER_SZ = 4;
+
+/**
+ * @class FixedPage - block of equal-length records
+ */
+
+// FixedPage constructor
+FixedPage::FixedPage(Dbt &block, BlockID block_id, u_int16_t record_size, bool is_new) : DbBlock(block, block_id),
+                                                                                        record_size(record_size)
+{
+    this->max_records = capacity(this->block.get_size(), record_size);
+    if (this->max_records == 0)
+        throw DbBlockNoRoomError("record does not fit in a block");
+    this->data_offset = FIXED_HEADER_SZ + (this->max_records + 7) / 8;
+    this->bitmap = (u_int8_t *)this->block.get_data() + FIXED_HEADER_SZ;
+    if (is_new)
+    {
+        this->num_records = 0;
+        this->first_free = 1;
+        memset(this->bitmap, 0, this->data_offset - FIXED_HEADER_SZ);
+        put_header();
+    }
+    else
+    {
+        this->num_records = *(u16 *)this->block.get_data();
+        this->first_free = *(u16 *)((char *)this->block.get_data() + 2);
+    }
+}
+
+// Largest n with header + bitmap of n bits + n records no bigger than the block.
+u_int16_t FixedPage::capacity(u_int32_t block_sz, u_int16_t record_size)
+{
+    if (record_size == 0 || block_sz <= FIXED_HEADER_SZ)
+        return 0;
+    u_int32_t n = (block_sz - FIXED_HEADER_SZ) * 8 / (8 * record_size + 1);
+    while (n > 0 && FIXED_HEADER_SZ + (n + 7) / 8 + n * record_size > block_sz)
+        n--;
+    return n > UINT16_MAX ? UINT16_MAX : n;
+}
+
+// Put the record in the lowest free slot. Return its id.
+RecordID FixedPage::add(const Dbt *data)
+{
+    if (data->get_size() != this->record_size)
+        throw DbRelationError("record is not " + std::to_string(this->record_size) + " bytes");
+    if (this->num_records == this->max_records)
+        throw DbBlockNoRoomError("not enough room for new record");
+    RecordID record_id = this->first_free;
+    while (present(record_id))
+        record_id++;
+    this->bitmap[(record_id - 1) / 8] |= 1 << ((record_id - 1) % 8);
+    memcpy(address(record_id), data->get_data(), this->record_size);
+    this->num_records++;
+    this->first_free = record_id + 1;
+    put_header();
+    return record_id;
+}
+
+// Get a record from the block. Return nullptr if it is not there.
+Dbt *FixedPage::get(RecordID record_id)
+{
+    RecordView record;
+    if (!view(record_id, record))
+        return nullptr;
+    return new Dbt((void *)record.data, record.size);
+}
+
+// Point record at the bytes of a record inside the block. Return false if it is not there.
+bool FixedPage::view(RecordID record_id, RecordView &record)
+{
+    if (!present(record_id))
+        return false;
+    record.data = address(record_id);
+    record.size = this->record_size;
+    return true;
+}
+
+// Overwrite a record in place.
+void FixedPage::put(RecordID record_id, const Dbt &data)
+{
+    if (data.get_size() != this->record_size)
+        throw DbRelationError("record is not " + std::to_string(this->record_size) + " bytes");
+    if (!present(record_id))
+        throw DbRelationError("record has been deleted");
+    memcpy(address(record_id), data.get_data(), this->record_size);
+}
+
+// Clear the record's bit. Its slot is free for the next add().
+void FixedPage::del(RecordID record_id)
+{
+    if (!present(record_id))
+        return;
+    this->bitmap[(record_id - 1) / 8] &= ~(1 << ((record_id - 1) % 8));
+    this->num_records--;
+    if (record_id < this->first_free)
+        this->first_free = record_id;
+    put_header();
+}
+
+// Sequence of all present record ids.
+RecordIDs *FixedPage::ids(void)
+{
+    RecordIDs *record_ids = new RecordIDs();
+    RecordID record_id = 0;
+    while (next_id(record_id))
+        record_ids->push_back(record_id);
+    return record_ids;
+}
+
+// Advance record_id to the next present record id (start from 0). Empty bitmap bytes are skipped whole.
+bool FixedPage::next_id(RecordID &record_id)
+{
+    RecordID next = record_id + 1;
+    while (next <= this->max_records)
+    {
+        if ((next - 1) % 8 == 0 && this->bitmap[(next - 1) / 8] == 0)
+        {
+            next += 8;
+            continue;
+        }
+        if (present(next))
+        {
+            record_id = next;
+            return true;
+        }
+        next++;
+    }
+    return false;
+}
+
+// Room for this many more records.
+u_int32_t FixedPage::get_free_space()
+{
+    return (u_int32_t)(this->max_records - this->num_records) * this->record_size;
+}
+
+bool FixedPage::present(RecordID record_id)
+{
+    if (record_id == 0 || record_id > this->max_records)
+        return false;
+    return (this->bitmap[(record_id - 1) / 8] >> ((record_id - 1) % 8)) & 1;
+}
+
+char *FixedPage::address(RecordID record_id)
+{
+    return (char *)this->block.get_data() + this->data_offset + (record_id - 1) * this->record_size;
+}
+
+void FixedPage::put_header()
+{
+    *(u16 *)this->block.get_data() = this->num_records;
+    *(u16 *)((char *)this->block.get_data() + 2) = this->first_free;
+}
+
+/**
+ * @class FixedHeapFile - HeapFile of FixedPage blocks
+ */
+
+FixedHeapFile::FixedHeapFile(std::string name, u_int16_t record_size, uint block_sz) : HeapFile(name, block_sz),
+                                                                                      record_size(record_size) {}
+
+DbBlock *FixedHeapFile::new_block(Dbt &data, BlockID block_id, bool is_new)
+{
+    return new FixedPage(data, block_id, this->record_size, is_new);
+}
+
+/**
+ * @class FixedHeapTable - HeapTable for tables with only fixed-width columns
+ */
+
+// Fixed-width columns have to be checked before the file is made.
+static FixedHeapFile *fixed_heap_file(Identifier table_name, const ColumnAttributes &column_attributes, uint block_sz)
+{
+    u_int16_t record_size = FixedHeapTable::record_size(column_attributes);
+    if (record_size == 0)
+        throw DbRelationError(table_name + " has variable width columns");
+    return new FixedHeapFile(table_name, record_size, block_sz);
+}
+
+FixedHeapTable::FixedHeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                               uint block_sz) : HeapTable(table_name, column_names, column_attributes,
+                                                          fixed_heap_file(table_name, column_attributes, block_sz)) {}
+
+// Same sizes HeapTable::marshal() writes.
+u_int16_t FixedHeapTable::record_size(const ColumnAttributes &column_attributes)
+{
+    u_int16_t size = 0;
+    for (ColumnAttribute ca : column_attributes)
+    {
+        if (ca.get_data_type() == ColumnAttribute::DataType::INT)
+            size += sizeof(int32_t);
+        else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN)
+            size += sizeof(u_int8_t);
+        else
+            return 0;
+    }
+    return size;
+}
+
+// test function -- returns true if all tests pass
+bool test_fixed_heap_storage()
+{
+    // a page of 5-byte records
+    char block[DbBlock::BLOCK_SZ];
+    Dbt data(block, sizeof(block));
+    FixedPage page(data, 1, 5, true);
+    u_int16_t max_records = FixedPage::capacity(DbBlock::BLOCK_SZ, 5);
+    char record[] = "abcd";
+    Dbt record_dbt(record, 5);
+    RecordID last = 0;
+    for (u_int16_t i = 0; i < max_records; i++)
+        last = page.add(&record_dbt);
+    if (last != max_records || page.get_free_space() != 0)
+    {
+        std::cout << "Wrong fixed page capacity" << std::endl;
+        return false;
+    }
+    page.del(3);
+    page.del(7);
+    RecordIDs *ids = page.ids();
+    bool listed = ids->size() == (size_t)(max_records - 2) && ids->at(2) == 4;
+    delete ids;
+    if (!listed || page.add(&record_dbt) != 3 || page.add(&record_dbt) != 7)
+    {
+        std::cout << "Wrong fixed page slot reuse" << std::endl;
+        return false;
+    }
+
+    // a table of INT and BOOLEAN columns
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    FixedHeapTable table("_test_fixed_cpp", column_names, column_attributes);
+    table.create();
+    ValueDict row;
+    Handle handle;
+    for (int i = 0; i < 1000; i++)
+    {
+        row["a"] = Value(i);
+        row["b"] = Value(i % 2 == 0 ? 1 : 0);
+        handle = table.insert(&row);
+    }
+    ValueDict where;
+    where["a"] = Value(999);
+    Handles *handles = table.select(&where);
+    bool found = handles->size() == 1 && handles->at(0) == handle;
+    delete handles;
+    ValueDict *result = table.project(handle);
+    found = found && (*result)["a"].n == 999 && (*result)["b"].n == 0;
+    delete result;
+    table.drop();
+    if (!found)
+    {
+        std::cout << "Wrong fixed heap table rows" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file fixed_heap_storage.h - Heap storage for tables whose columns are all fixed width.
+ * FixedPage: DbBlock
+ * FixedHeapFile: HeapFile
+ * FixedHeapTable: HeapTable
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * @class FixedPage - block of equal-length records (implementation of DbBlock)
+ *
+ *      Every record is record_size bytes, so record i simply lives at a computed offset and there
+        is no per-record header. Which records are present is kept in a bitmap. Record ids start at 1
+        and add() takes the lowest free one.
+            Bytes 0x00 - 0x01: number of records present
+            Bytes 0x02 - 0x03: no record id below this one is free (hint for add())
+            Bytes 0x04 - ...: presence bitmap, one bit per record id (bit 0 of byte 0 is record 1)
+            then the records, record i at data_offset + (i-1)*record_size
+ */
+class FixedPage : public DbBlock
+{
+public:
+    FixedPage(Dbt &block, BlockID block_id, u_int16_t record_size, bool is_new = false);
+
+    virtual ~FixedPage() {}
+
+    FixedPage(const FixedPage &other) = delete;
+
+    FixedPage(FixedPage &&temp) = delete;
+
+    FixedPage &operator=(const FixedPage &other) = delete;
+
+    FixedPage &operator=(FixedPage &temp) = delete;
+
+    virtual RecordID add(const Dbt *data);
+
+    virtual Dbt *get(RecordID record_id);
+
+    virtual bool view(RecordID record_id, RecordView &record);
+
+    virtual void put(RecordID record_id, const Dbt &data);
+
+    virtual void del(RecordID record_id);
+
+    virtual RecordIDs *ids(void);
+
+    virtual bool next_id(RecordID &record_id);
+
+    virtual u_int32_t get_free_space();
+
+    /**
+     * Number of records a block of block_sz bytes can hold.
+     */
+    static u_int16_t capacity(u_int32_t block_sz, u_int16_t record_size);
+
+protected:
+    u_int16_t record_size;
+    u_int16_t max_records;
+    u_int16_t data_offset;
+    u_int16_t num_records;
+    u_int16_t first_free;
+    u_int8_t *bitmap;
+
+    virtual bool present(RecordID record_id);
+
+    virtual char *address(RecordID record_id);
+
+    virtual void put_header();
+};
+
+/**
+ * @class FixedHeapFile - HeapFile of FixedPage blocks
+ */
+class FixedHeapFile : public HeapFile
+{
+public:
+    FixedHeapFile(std::string name, u_int16_t record_size, uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~FixedHeapFile() {}
+
+    FixedHeapFile(const FixedHeapFile &other) = delete;
+
+    FixedHeapFile(FixedHeapFile &&temp) = delete;
+
+    FixedHeapFile &operator=(const FixedHeapFile &other) = delete;
+
+    FixedHeapFile &operator=(FixedHeapFile &&temp) = delete;
+
+protected:
+    u_int16_t record_size;
+
+    virtual DbBlock *new_block(Dbt &data, BlockID block_id, bool is_new);
+};
+
+/**
+ * @class FixedHeapTable - HeapTable for tables with only fixed-width (INT and BOOLEAN) columns
+ *
+ *      Rows are marshaled exactly as in HeapTable, which for these columns always takes the same
+        number of bytes, and stored in a FixedHeapFile. Tables::get_table() picks this automatically.
+ */
+class FixedHeapTable : public HeapTable
+{
+public:
+    FixedHeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                   uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~FixedHeapTable() {}
+
+    FixedHeapTable(const FixedHeapTable &other) = delete;
+
+    FixedHeapTable(FixedHeapTable &&temp) = delete;
+
+    FixedHeapTable &operator=(const FixedHeapTable &other) = delete;
+
+    FixedHeapTable &operator=(FixedHeapTable &&temp) = delete;
+
+    /**
+     * Marshaled size of a row with these columns.
+     * @returns  the size in bytes, or 0 if any column is variable width
+     */
+    static u_int16_t record_size(const ColumnAttributes &column_attributes);
+};
+
+bool test_fixed_heap_storage();
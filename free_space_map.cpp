@@ -0,0 +1,264 @@
+/**
+ * @file free_space_map.cpp - Implementation of FreeSpaceMap.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "free_space_map.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// layout of the metadata record (record 1)
+struct MetaRecord
+{
+    u_int32_t magic;
+    u_int32_t block_sz;
+    u_int32_t last;
+    u_int32_t allocated;
+    u_int32_t first_free;
+    u_int32_t in_use; // 0 in maps saved before there was a mark, which were always saved on close
+    u_int64_t row_count;
+};
+
+// entries are filled with UNKNOWN by reference, so it needs a definition
+const u_int8_t FreeSpaceMap::EMPTY;
+const u_int8_t FreeSpaceMap::UNKNOWN;
+
+FreeSpaceMap::FreeSpaceMap(std::string name, uint block_sz) : dbfilename("./" + name + "_fsm.db"), closed(true),
+                                                               db(_DB_ENV, 0), unit(std::max(block_sz / 256, 1U)),
+                                                               count(0), first_free(1), meta(), meta_dirty(false),
+                                                               saved_first_free(1), in_use(false) {}
+
+// Don't lose updates if the owning file is never explicitly closed.
+FreeSpaceMap::~FreeSpaceMap()
+{
+    if (!this->closed)
+        flush();
+}
+
+// Create the map file. There are no blocks yet.
+void FreeSpaceMap::create()
+{
+    db_open(DB_CREATE);
+    this->entries.clear();
+    this->dirty.clear();
+    this->count = 0;
+    this->first_free = 1;
+    this->meta = HeapFileMeta(); // nothing saved yet, so the first set_meta() always counts
+    this->meta_dirty = false;
+    this->saved_first_free = 1;
+    put_meta(nullptr);
+    this->in_use = true; // blank until the first flush()
+}
+
+// Remove the map file.
+void FreeSpaceMap::drop()
+{
+    if (!this->closed)
+    {
+        this->db.close(0);
+        this->closed = true;
+    }
+    Db db(_DB_ENV, 0);
+    db.remove(this->dbfilename.c_str(), nullptr, 0);
+}
+
+// Load the metadata and then the saved entries for the blocks it says the heap file has.
+bool FreeSpaceMap::open(HeapFileMeta &meta)
+{
+    if (!this->closed)
+        return false;
+    db_open(0);
+    this->entries.clear();
+    this->dirty.clear();
+    this->count = 0;
+    this->first_free = 1;
+    this->meta = HeapFileMeta();
+    this->meta_dirty = false;
+
+    std::vector<char> bytes(CHUNK_SZ, 0);
+    db_recno_t recno = 1;
+    Dbt key(&recno, sizeof(recno));
+    Dbt data(bytes.data(), CHUNK_SZ);
+    data.set_ulen(CHUNK_SZ);
+    data.set_flags(DB_DBT_USERMEM);
+    MetaRecord record;
+    bool found = this->db.get(nullptr, &key, &data, 0) == 0;
+    memcpy(&record, bytes.data(), sizeof(record));
+    this->in_use = !found || record.magic != MAGIC || record.in_use != 0;
+    if (this->in_use)
+        return false; // the next flush() saves what the caller works out instead
+
+    meta.block_sz = record.block_sz;
+    meta.last = record.last;
+    meta.allocated = record.allocated;
+    meta.row_count = record.row_count;
+    this->meta = meta;
+    db_recno_t chunks = (record.last + CHUNK_SZ - 1) / CHUNK_SZ;
+    this->entries.assign(chunks * CHUNK_SZ, UNKNOWN);
+    this->dirty.assign(chunks, false);
+    for (db_recno_t i = 1; i <= chunks; i++)
+    {
+        db_recno_t recno = i + 1;
+        Dbt key(&recno, sizeof(recno));
+        Dbt data(&this->entries[(i - 1) * CHUNK_SZ], CHUNK_SZ);
+        data.set_ulen(CHUNK_SZ);
+        data.set_flags(DB_DBT_USERMEM);
+        this->db.get(nullptr, &key, &data, 0);
+    }
+    this->count = record.last;
+    this->first_free = std::max(record.first_free, 1U);
+    this->saved_first_free = record.first_free;
+    return true;
+}
+
+// Shrink or grow to exactly last blocks. Entries of blocks cut off are forgotten, so that a block
+// given the same id later is looked at afresh.
+void FreeSpaceMap::cover(BlockID last)
+{
+    if (last != this->count)
+        touch();
+    for (BlockID block_id = last + 1; block_id <= this->count; block_id++)
+    {
+        this->entries[block_id - 1] = UNKNOWN;
+        this->dirty[(block_id - 1) / CHUNK_SZ] = true;
+    }
+    if (last < this->count)
+        this->count = last;
+    resize(last);
+}
+
+// Saved by the next flush(), unless nothing in it has changed.
+void FreeSpaceMap::set_meta(const HeapFileMeta &meta)
+{
+    if (meta.block_sz == this->meta.block_sz && meta.last == this->meta.last &&
+        meta.allocated == this->meta.allocated && meta.row_count == this->meta.row_count)
+        return;
+    touch();
+    this->meta = meta;
+    this->meta_dirty = true;
+}
+
+// Mark the saved record in use, keeping what it says otherwise.
+void FreeSpaceMap::touch()
+{
+    if (this->in_use || this->closed)
+        return;
+    MetaRecord record = {MAGIC, this->meta.block_sz, this->meta.last, this->meta.allocated, this->saved_first_free, 1,
+                         this->meta.row_count};
+    put_meta(&record);
+    this->in_use = true;
+}
+
+// Save and close.
+void FreeSpaceMap::close()
+{
+    if (this->closed)
+        return;
+    flush();
+    this->db.close(0);
+    this->closed = true;
+}
+
+// An entry's unit is 1/256 of a block.
+void FreeSpaceMap::set_block_size(uint block_sz)
+{
+    this->unit = std::max(block_sz / 256, 1U);
+}
+
+// Linear walk of the entries starting at the first one known to be non-zero.
+BlockID FreeSpaceMap::find(u_int32_t size)
+{
+    u_int32_t needed = (size + this->unit - 1) / this->unit;
+    while (this->first_free <= this->count && this->entries[this->first_free - 1] == 0)
+        this->first_free++;
+    for (BlockID block_id = this->first_free; block_id <= this->count; block_id++)
+        if (this->entries[block_id - 1] >= needed)
+            return block_id;
+    return 0;
+}
+
+// Set one block's entry, only marking its chunk dirty if the entry actually changes.
+// An empty block has at least 255 units free, so EMPTY never promises more room than there is.
+void FreeSpaceMap::set(BlockID block_id, u_int32_t free, bool empty)
+{
+    if (block_id > this->count)
+        resize(block_id);
+    u_int8_t entry = empty ? EMPTY : (u_int8_t)std::min(free / this->unit, (u_int32_t)EMPTY - 1);
+    u_int8_t &current = this->entries[block_id - 1];
+    if (current == entry)
+        return;
+    touch();
+    current = entry;
+    this->dirty[(block_id - 1) / CHUNK_SZ] = true;
+    if (entry != 0 && block_id < this->first_free)
+        this->first_free = block_id;
+}
+
+// Anything past the blocks we cover is unknown.
+bool FreeSpaceMap::is_empty(BlockID block_id) const
+{
+    return block_id >= 1 && block_id <= this->count && this->entries[block_id - 1] == EMPTY;
+}
+
+// Write the changed chunks, then the metadata record if it has changed.
+void FreeSpaceMap::flush()
+{
+    for (db_recno_t i = 1; i <= this->dirty.size(); i++)
+    {
+        if (!this->dirty[i - 1])
+            continue;
+        db_recno_t recno = i + 1;
+        Dbt key(&recno, sizeof(recno));
+        Dbt data(&this->entries[(i - 1) * CHUNK_SZ], CHUNK_SZ);
+        this->db.put(nullptr, &key, &data, 0);
+        this->dirty[i - 1] = false;
+    }
+    if (!this->meta_dirty && !this->in_use && this->first_free == this->saved_first_free)
+        return;
+    if (this->meta.block_sz == 0)
+        return; // opened without metadata and never given any: leave the record untrusted
+    MetaRecord record = {MAGIC, this->meta.block_sz, this->meta.last, this->meta.allocated, this->first_free, 0,
+                         this->meta.row_count};
+    put_meta(&record);
+    this->meta_dirty = false;
+    this->saved_first_free = this->first_free;
+    this->in_use = false;
+}
+
+// Write the metadata record, or a blank one (which open() won't trust) if record is nullptr.
+void FreeSpaceMap::put_meta(const void *record)
+{
+    std::vector<char> bytes(CHUNK_SZ, 0);
+    if (record != nullptr)
+        memcpy(bytes.data(), record, sizeof(MetaRecord));
+    db_recno_t recno = 1;
+    Dbt key(&recno, sizeof(recno));
+    Dbt data(bytes.data(), CHUNK_SZ);
+    this->db.put(nullptr, &key, &data, 0);
+}
+
+// Open the Berkeley DB file with fixed-length records of one chunk each.
+void FreeSpaceMap::db_open(uint flags)
+{
+    if (!this->closed)
+        return;
+    this->db.set_re_len(CHUNK_SZ);
+    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+    this->closed = false;
+}
+
+// Cover count blocks. Entries we have never set (including the unused tail of the last chunk, as saved)
+// are UNKNOWN, so a block we know nothing about gets looked at rather than ignored.
+void FreeSpaceMap::resize(BlockID count)
+{
+    size_t chunks = (count + CHUNK_SZ - 1) / CHUNK_SZ;
+    if (chunks > this->dirty.size())
+    {
+        this->entries.resize(chunks * CHUNK_SZ, UNKNOWN);
+        this->dirty.resize(chunks, true);
+    }
+    if (count > this->count)
+        this->count = count;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file free_space_map.h - Persistent summary of the free space in each block of a HeapFile.
+ * FreeSpaceMap
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <vector>
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class HeapFileMeta - what a HeapFile needs to know about itself to open, saved with its FreeSpaceMap
+ */
+struct HeapFileMeta
+{
+    u_int32_t block_sz;
+    BlockID last;        // blocks handed out
+    BlockID allocated;   // blocks in the file
+    u_int64_t row_count; // records in all the blocks
+};
+
+/**
+ * @class FreeSpaceMap - one byte per block saying roughly how much room the block has left
+ *
+ *      Entry i is the free space of block i+1 in units of block_sz/256 bytes, rounded down,
+        so an entry never promises more room than the block really has. The top two values are
+        kept apart: EMPTY for a block holding nothing at all, which scans can skip without reading
+        it, and UNKNOWN for blocks we have not looked at yet, which makes HeapTable::append() check
+        them once. Every other block's entry stops just below EMPTY.
+        The entries are kept in memory and saved in a Berkeley DB RecNo file next to the
+        heap file (<name>_fsm.db), one record of CHUNK_SZ entries at a time.
+        Record 1 of that file is a metadata record instead: MAGIC, then the HeapFileMeta given to
+        set_meta() and the first block with room, so a heap file can be opened without asking
+        Berkeley DB anything. The entries follow from record 2.
+        The first change after the record is saved marks it in use (one write), and the next
+        flush() clears the mark, so a map left in use by a crash is not trusted by open().
+ */
+class FreeSpaceMap
+{
+public:
+    /**
+     * entries per Berkeley DB record
+     */
+    static const uint CHUNK_SZ = 4096;
+
+    /**
+     * first word of the metadata record
+     */
+    static const u_int32_t MAGIC = 0x46534D32; // "FSM2" (an "FSM1" map has no EMPTY entries, so isn't trusted)
+
+    /**
+     * entry of a block with no records in it
+     */
+    static const u_int8_t EMPTY = 254;
+
+    /**
+     * entry of a block nobody has looked at yet
+     */
+    static const u_int8_t UNKNOWN = 255;
+
+    FreeSpaceMap(std::string name, uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~FreeSpaceMap();
+
+    FreeSpaceMap(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap(FreeSpaceMap &&temp) = delete;
+
+    FreeSpaceMap &operator=(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap &operator=(FreeSpaceMap &&temp) = delete;
+
+    /**
+     * Create the (empty) map file.
+     */
+    virtual void create();
+
+    /**
+     * Remove the map file.
+     */
+    virtual void drop();
+
+    /**
+     * Open the map file and load the entries. Nothing is written until something changes.
+     * @param meta  returned by reference: the heap file's metadata as last saved (untouched if there is none)
+     * @returns     false if there is no metadata to trust (a new map, one saved by an older version, or one
+     *              left in use); the entries are then unknown and the caller has to cover() the heap file's blocks
+     * @throws      DbException if there is no map file (only create() makes one)
+     */
+    virtual bool open(HeapFileMeta &meta);
+
+    /**
+     * Make the map cover exactly the blocks up to last (new ones are unknown, so assumed to have room;
+     * ones dropped become unknown again).
+     * @param last  last block id of the heap file
+     */
+    virtual void cover(BlockID last);
+
+    /**
+     * Remember the heap file's metadata, to be saved with the entries (only if it differs from what was saved).
+     * @param meta  current metadata of the heap file
+     */
+    virtual void set_meta(const HeapFileMeta &meta);
+
+    /**
+     * Note that the heap file is changing, so the saved metadata can't be trusted until the next flush().
+     * Only the first call after each flush() writes anything.
+     */
+    virtual void touch();
+
+    /**
+     * Save any changed entries and close the map file.
+     */
+    virtual void close();
+
+    /**
+     * Set the size of the blocks the entries describe (before any entries are set).
+     * @param block_sz  size of the heap file's blocks in bytes
+     */
+    virtual void set_block_size(uint block_sz);
+
+    /**
+     * Find the first block that should have room for size bytes.
+     * @param size  number of bytes needed
+     * @returns     the block id, or 0 if no block has room
+     */
+    virtual BlockID find(u_int32_t size);
+
+    /**
+     * Record how much room a block has (the map grows to cover new blocks).
+     * @param block_id  which block
+     * @param free      number of bytes free in the block
+     * @param empty     whether the block holds nothing at all
+     */
+    virtual void set(BlockID block_id, u_int32_t free, bool empty = false);
+
+    /**
+     * Whether the block is known to hold nothing, so a scan can pass it by.
+     * @param block_id  which block
+     * @returns         false if it has records, or we don't know
+     */
+    virtual bool is_empty(BlockID block_id) const;
+
+    /**
+     * Write changed entries back to the map file.
+     */
+    virtual void flush();
+
+protected:
+    std::string dbfilename;
+    bool closed;
+    Db db;
+    uint unit;                     // bytes per step of an entry
+    BlockID count;                 // number of blocks covered by entries
+    std::vector<u_int8_t> entries; // always a whole number of chunks
+    std::vector<bool> dirty;       // one flag per chunk
+    BlockID first_free;            // no block before this one has any room
+    HeapFileMeta meta;
+    bool meta_dirty;
+    BlockID saved_first_free; // first_free as the metadata record has it
+    bool in_use;              // the metadata record is marked in use (or blank), so open() won't trust it
+
+    virtual void db_open(uint flags);
+
+    virtual void resize(BlockID count);
+
+    virtual void put_meta(const void *record);
+};
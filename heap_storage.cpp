@@ -11,8 +11,18 @@
  * @see "Seattle University, CPSC5300, Spring 2022"
 **/
 #include "heap_storage.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include "arena.h"
+#include "mmap_page_file.h"
+#include "worker_pool.h"
 
 using namespace std;
 
@@ -24,38 +34,70 @@ typedef u_int16_t u16;
  *      Manage a database block that contains several records.
         Modeled after slotted-page from Database Systems Concepts, 6ed, Figure 10-9.
 
-        Record id are handed out sequentially starting with 1 as records are added with add().
+        Record ids start at 1. add() reuses the slot of a deleted record when there is one (the
+        lowest, found through a hint in the block header) and only otherwise hands out the next id.
         Each record has a header which is a fixed offset from the beginning of the block:
             Bytes 0x00 - Ox01: number of records
             Bytes 0x02 - 0x03: offset to end of free space
-            Bytes 0x04 - 0x05: size of record 1
-            Bytes 0x06 - 0x07: offset to record 1
+            Bytes 0x04 - 0x05: number of fragmented bytes (left behind by del() and put())
+            Bytes 0x06 - 0x07: first free record id (0 if every slot is in use)
+            Bytes 0x08 - 0x09: size of record 1
+            Bytes 0x0A - 0x0B: offset to record 1
             etc.
+        Deleting the highest record id shrinks the slot directory instead of leaving a free slot.
+        Deleting or shrinking a record only leaves a hole. The holes are squeezed out all at once
+        by compact(), and only when add() or put() needs more contiguous room than there is.
+        forward() turns a record into a stub: size 0, offset to the 6 bytes of its new BlockID
+        and RecordID. A record put here by add_moved() has MOVED set in its size.
+        Every record takes up at least those 6 bytes, even if its size says less, so that
+        forward() can always write the stub where the record was.
 **/
 
+// std::max() takes it by reference, so it needs a definition
+const u_int16_t SlottedPage::STUB_SZ;
+
 // SlottedPage constructor:
 SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(block, block_id)
 {
     if (is_new)
     {
         this->num_records = 0;
-        this->end_free = DbBlock::BLOCK_SZ - 1;
+        this->end_free = this->block.get_size() - 1;
+        this->fragmented = 0;
+        this->free_slot = 0;
         put_header();
     }
     else
     {
         get_header(this->num_records, this->end_free);
+        this->fragmented = get_n(4);
+        this->free_slot = get_n(6);
     }
 }
 
 // Add a new record to the block. Return its id..
 RecordID SlottedPage::add(const Dbt *data)
 {
-    if (!has_room(data->get_size() + 4))
-        throw DbBlockNoRoomError("not enough room for new record");
-    u16 id = ++this->num_records;
+    if (data->get_size() == 0 || data->get_size() > MAX_RECORD_SZ)
+        throw DbRelationError("record must be 1 to " + std::to_string(MAX_RECORD_SZ) + " bytes");
     u16 size = (u16)data->get_size();
-    this->end_free -= size;
+    u16 footprint = std::max(size, STUB_SZ);
+    u_int32_t needed = footprint + (this->free_slot != 0 ? 0 : 4); // a reused slot has its header already
+    if (!has_room(needed))
+        throw DbBlockNoRoomError("not enough room for new record");
+    if (contiguous_room() < needed)
+        compact();
+    u16 id;
+    if (this->free_slot != 0)
+    {
+        id = this->free_slot;
+        this->free_slot = next_free_slot(id);
+    }
+    else
+    {
+        id = ++this->num_records;
+    }
+    this->end_free -= footprint;
     u16 loc = this->end_free + 1U;
     put_header();
     put_header(id, size, loc);
@@ -65,56 +107,95 @@ RecordID SlottedPage::add(const Dbt *data)
 
 // Get a record from the block. Return None if it has been deleted.
 Dbt *SlottedPage::get(RecordID record_id)
+{
+    RecordView record;
+    if (!view(record_id, record))
+    {
+        return nullptr; // this is just a tombstone, record has been deleted
+    }
+    return new Dbt((void *)record.data, record.size);
+}
+
+// Point record at the bytes of a record inside the block. Return false if it has been deleted.
+bool SlottedPage::view(RecordID record_id, RecordView &record)
 {
     u16 size, loc;
     get_header(size, loc, record_id);
-    if (loc == 0)
+    if (loc == 0 || size == 0)
     {
-        return nullptr; // this is just a tombstone, record has been deleted
+        return false; // deleted, or just a stub
     }
-    return new Dbt(this->address(loc), size);
+    record.data = (const char *)this->address(loc);
+    record.size = size & ~MOVED;
+    return true;
 }
 
 // Replace the record with the given data. Raises ValueError if it won't fit.
+// A moved record stays moved; a stub becomes a record again.
 void SlottedPage::put(RecordID record_id, const Dbt &data)
 {
+    if (data.get_size() == 0 || data.get_size() > MAX_RECORD_SZ)
+        throw DbRelationError("record must be 1 to " + std::to_string(MAX_RECORD_SZ) + " bytes");
     u16 header_size, loc;
     get_header(header_size, loc, record_id);
+    u16 moved = header_size & MOVED;
+    header_size = stored_size(header_size, loc);
     u16 data_size = (u16)data.get_size();
 
-    // That means this record is too large
-    if (data_size > header_size)
+    if (data_size <= header_size)
     {
-        u16 extra = data_size - header_size;
-        if (!this->has_room(extra))
-        {
-            throw DbBlockNoRoomError("Not enough room in block");
-        }
-        // Put this record on index loc - extra and the header will be fulled.
-        slide(loc, loc - extra);
-        memcpy(this->address(loc - extra), data.get_data(), data_size);
+        // Shrinking (or same size) stays where it is; the tail beyond the minimum footprint becomes a hole.
+        memcpy(this->address(loc), data.get_data(), data_size);
+        this->fragmented += header_size - std::max(data_size, STUB_SZ);
+        put_header();
+        put_header(record_id, data_size | moved, loc);
+        return;
     }
-    else
+
+    // That means this record is too large, so give up its old spot and take a new one
+    if (!this->has_room(data_size - header_size))
     {
-        // Put this record on index loc. Normally one.
-        memcpy(this->address(loc), data.get_data(), data_size);
-        slide(loc + data_size, loc + header_size);
+        throw DbBlockNoRoomError("Not enough room in block");
     }
-    get_header(header_size, loc, record_id);
-    put_header(record_id, data_size, loc);
+    put_header(record_id, 0, 0); // so compact() leaves it out
+    release(header_size, loc);
+    if (contiguous_room() < data_size)
+        compact();
+    this->end_free -= data_size;
+    loc = this->end_free + 1U;
+    put_header();
+    put_header(record_id, data_size | moved, loc);
+    memcpy(this->address(loc), data.get_data(), data_size);
 }
 
 // Mark the given id as deleted by changing its size to zero and its location to 0.
-// Compact the rest of the data in the block. But keep the record ids the same for everyone.
+// The record's bytes are left where they are until the next compact(), so the other record ids never change.
+// The slot is free for the next add(), unless it is at the end of the slot directory, which then shrinks.
 void SlottedPage::del(RecordID record_id)
 {
     u16 size, loc;
     get_header(size, loc, record_id);
+    if (loc == 0)
+        return;
     put_header(record_id, 0, 0);
-    slide(loc, loc + size);
+    release(stored_size(size, loc), loc);
+    if (record_id == this->num_records)
+    {
+        do
+        {
+            get_header(size, loc, --this->num_records);
+        } while (this->num_records > 0 && loc == 0);
+        if (this->free_slot > this->num_records)
+            this->free_slot = 0;
+    }
+    else if (this->free_slot == 0 || record_id < this->free_slot)
+    {
+        this->free_slot = record_id;
+    }
+    put_header();
 }
 
-// Sequence of all non-deleted record ids.
+// Sequence of all non-deleted record ids (stubs included, moved-in records not).
 RecordIDs *SlottedPage::ids(void)
 {
     RecordIDs *record_ids = new RecordIDs();
@@ -122,7 +203,7 @@ RecordIDs *SlottedPage::ids(void)
     for (RecordID record_id = 1; record_id <= this->num_records; record_id++)
     {
         get_header(size, loc, record_id);
-        if (loc != 0)
+        if (loc != 0 && (size & MOVED) == 0)
         {
             record_ids->push_back(record_id);
         }
@@ -130,11 +211,27 @@ RecordIDs *SlottedPage::ids(void)
     return record_ids;
 }
 
+// Advance record_id to the next non-deleted record id (start from 0), skipping moved-in records.
+bool SlottedPage::next_id(RecordID &record_id)
+{
+    u16 size, loc;
+    while (record_id < this->num_records)
+    {
+        get_header(size, loc, ++record_id);
+        if (loc != 0 && (size & MOVED) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Get the size and offset for given id. For id of zero, it is the block header.
 void SlottedPage::get_header(u_int16_t &size, u_int16_t &loc, RecordID id)
 {
-    size = get_n(4 * id);
-    loc = get_n(4 * id + 2);
+    u16 offset = id == 0 ? 0 : 4 * id + 4;
+    size = get_n(offset);
+    loc = get_n(offset + 2);
 }
 
 // Store the size and offset for given id. For id of zero, store the block header.
@@ -142,60 +239,153 @@ void SlottedPage::put_header(RecordID id, u16 size, u16 loc)
 {
     if (id == 0)
     { // called the put_header() version and using the default params
-        size = this->num_records;
-        loc = this->end_free;
+        put_n(0, this->num_records);
+        put_n(2, this->end_free);
+        put_n(4, this->fragmented);
+        put_n(6, this->free_slot);
+        return;
+    }
+    put_n((u16)(4 * id + 4), size);
+    put_n((u16)(4 * id + 6), loc);
+}
+
+// Shrink the record down to a stub pointing at target, where the caller has put it with add_moved().
+void SlottedPage::forward(RecordID record_id, Handle target)
+{
+    char stub[STUB_SZ];
+    memcpy(stub, &target.first, sizeof(BlockID));
+    memcpy(stub + sizeof(BlockID), &target.second, sizeof(RecordID));
+    put(record_id, Dbt(stub, STUB_SZ));
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    put_header(record_id, 0, loc);
+}
+
+// A stub is the only thing with a size of 0 that isn't deleted.
+bool SlottedPage::forwarded(RecordID record_id, Handle &target)
+{
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    if (loc == 0 || size != 0)
+        return false;
+    memcpy(&target.first, this->address(loc), sizeof(BlockID));
+    memcpy(&target.second, (char *)this->address(loc) + sizeof(BlockID), sizeof(RecordID));
+    return true;
+}
+
+// Add the record as usual, then mark it so next_id() passes it by.
+RecordID SlottedPage::add_moved(const Dbt *data)
+{
+    RecordID record_id = add(data);
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    put_header(record_id, size | MOVED, loc);
+    return record_id;
+}
+
+// Same walk as next_id(), stopping only at the records next_id() skips.
+bool SlottedPage::next_moved(RecordID &record_id)
+{
+    u16 size, loc;
+    while (record_id < this->num_records)
+    {
+        get_header(size, loc, ++record_id);
+        if (loc != 0 && (size & MOVED) != 0)
+        {
+            return true;
+        }
     }
-    put_n((u16)4 * id, size);
-    put_n((u16)(4 * id + 2), loc);
+    return false;
+}
+
+// Bytes a record takes up in the block, given the size and offset from its header (never less than a stub).
+u16 SlottedPage::stored_size(u16 size, u16 loc)
+{
+    if (loc == 0)
+        return 0;
+    return std::max((u16)(size & ~MOVED), STUB_SZ);
+}
+
+// Room left for a new record and its header (what has_room() checks add() against).
+// Less than a stub's worth is no room at all, since even a 1-byte record takes that much.
+u_int32_t SlottedPage::get_free_space()
+{
+    u_int32_t room = contiguous_room() + this->fragmented;
+    if (this->free_slot == 0)
+        room = room > 4 ? room - 4 : 0;
+    return room >= STUB_SZ ? room : 0;
 }
 
-// Calculate if we have room to store a record with given size.
+// Calculate if we have room to store a record with given size, counting the holes compact() would recover.
 // The size should include the 4 bytes
 // for the header, too, if this is an add.
 bool SlottedPage::has_room(u_int16_t size)
 {
-    u16 available = this->end_free - (this->num_records + 1) * 4;
-    return (size <= available);
+    return size <= (u_int32_t)contiguous_room() + this->fragmented;
 }
 
-/**If start < end, then remove data from offset start up to but not including offset end by sliding data
-    that is to the left of start to the right.
-    If start > end, then make room for extra data from end to start
-    by sliding data that is to the left of start to the left.
-    Also fix up any record headers whose data has slid. Assumes there is enough room if it is a left
-    shift (end < start).**/
-void SlottedPage::slide(u_int16_t start, u_int16_t end)
+// Bytes between the end of the record headers and the end of free space.
+u_int16_t SlottedPage::contiguous_room()
 {
-    int shift = end - start;
-    // u16 shift = end - start; We need int instead of u16
-    if (shift == 0)
-    {
-        return;
-    }
+    return this->end_free + 1U - (4U * this->num_records + 8U);
+}
 
-    // slide data
-    // Copy data from [end_free + 1] to [end_free + 1 + shift]
-    // Copy length is (end - start)
-    int bytes = start - (this->end_free + 1U);
-    memcpy((this->address((u16)(this->end_free + 1 + shift))), (this->address((u16)this->end_free + 1)), bytes);
+// Give back the bytes of a record that is going away. If it sits right at the end of free space,
+// the free space just grows over it; otherwise it is a hole until the next compact().
+// The caller writes the block header.
+void SlottedPage::release(u_int16_t size, u_int16_t loc)
+{
+    if (loc == this->end_free + 1U)
+        this->end_free += size;
+    else
+        this->fragmented += size;
+}
 
-    // fix up headers
+// Squeeze out all the holes: pack the live records against the end of the block, keeping their ids.
+// Records are moved in order of decreasing offset, so each one only ever moves right, over space
+// that is either free or already copied.
+void SlottedPage::compact()
+{
+    std::vector<std::pair<u16, RecordID>> live; // (loc, id)
     u16 size, loc;
-    RecordIDs *record_ids = ids();
-    for (auto const &record_id : *record_ids)
+    for (RecordID record_id = 1; record_id <= this->num_records; record_id++)
     {
         get_header(size, loc, record_id);
-        if (loc <= start)
+        if (loc != 0)
+            live.push_back(std::make_pair(loc, record_id));
+    }
+    std::sort(live.begin(), live.end(), std::greater<std::pair<u16, RecordID>>());
+
+    u_int32_t dest = this->block.get_size();
+    for (auto const &entry : live)
+    {
+        get_header(size, loc, entry.second);
+        u16 bytes = stored_size(size, loc);
+        dest -= bytes;
+        if (dest != loc)
         {
-            loc += shift;
-            put_header(record_id, size, loc);
+            memmove(this->address((u16)dest), this->address(loc), bytes);
+            put_header(entry.second, size, (u16)dest);
         }
     }
-    delete record_ids;
-    this->end_free += shift;
+    this->end_free = (u16)(dest - 1);
+    this->fragmented = 0;
     put_header();
 }
 
+// Lowest free record id above after, or 0 if there is none.
+u_int16_t SlottedPage::next_free_slot(u_int16_t after)
+{
+    u16 size, loc;
+    for (RecordID record_id = after + 1U; record_id <= this->num_records; record_id++)
+    {
+        get_header(size, loc, record_id);
+        if (loc == 0)
+            return record_id;
+    }
+    return 0;
+}
+
 // Get 2-byte integer at given offset in block.
 u16 SlottedPage::get_n(u16 offset)
 {
@@ -223,90 +413,237 @@ void *SlottedPage::address(u16 offset)
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one of our
         database blocks for each Berkeley DB record in the RecNo file.
-        In this way we are using Berkeley DB
-        for buffer management and file management.
+        Berkeley DB does the file management; blocks are cached in our own BufferPool.
         Uses SlottedPage for storing records within blocks.
 **/
 
-// HeapFile constructor has been declared in heap_storage.h
+// HeapFile constructor
+// block_sz is only used if the file gets created; an existing file keeps its own block size.
+// The file name is known from the start (with "./", or Db::open says "Is a directory"), since drop() may come
+// before the Berkeley DB file has ever been opened.
+HeapFile::HeapFile(std::string name, uint block_sz) : DbFile(name), dbfilename("./" + name + ".db"), last(0), allocated(0), block_sz(block_sz),
+                                                      row_count(0), closed(true), lazy(false), db(_DB_ENV, 0), pool(db, BufferPool::DEFAULT_CAPACITY, block_sz),
+                                                      fsm(name, block_sz)
+{
+    if (!DbBlock::is_valid_size(block_sz))
+        throw DbRelationError("block size must be a power of two from " + std::to_string(DbBlock::BLOCK_SZ) + " to " +
+                              std::to_string(DbBlock::MAX_BLOCK_SZ));
+}
+
+// Make sure nothing cached is lost if the file is never explicitly closed.
+HeapFile::~HeapFile()
+{
+    if (!this->closed)
+    {
+        this->pool.flush();
+        save_meta();
+    }
+}
 
 // Create physical file.
 void HeapFile::create(void)
 {
     db_open(DB_CREATE | DB_EXCL);
-    SlottedPage *block = get_new(); // first block of the file
-    delete block;
+    this->last = this->allocated = 0;
+    this->row_count = 0;
+    this->fsm.create();
+    DbBlock *block = get_new(); // first block of the file
+    release(block);
 }
 
 // Delete the physical file
 void HeapFile::drop(void)
 {
+    this->pool.reset(false); // no point writing back blocks of a file we are removing
     close();
+    this->fsm.drop();
     Db db(_DB_ENV, 0);
     db.remove(this->dbfilename.c_str(), nullptr, 0);
 }
 
 // Open physical file.
+// Normally the saved metadata is all we need; Berkeley DB is only asked when there is none.
+// A file made before we kept a free-space map gets one, but only once the file itself has opened,
+// so a table that isn't there leaves nothing behind.
 void HeapFile::open(void)
 {
+    if (!this->closed)
+        return;
+    HeapFileMeta meta;
+    bool mapped = true;
+    try
+    {
+        if (this->fsm.open(meta))
+        {
+            this->block_sz = meta.block_sz;
+            this->last = meta.last;
+            this->allocated = meta.allocated;
+            this->row_count = meta.row_count;
+            this->pool.set_block_size(this->block_sz);
+            this->fsm.set_block_size(this->block_sz);
+            this->closed = false;
+            this->lazy = true;
+            return;
+        }
+    }
+    catch (DbException &e)
+    {
+        mapped = false;
+    }
     db_open();
+    measure();
+    if (!mapped)
+        this->fsm.create();
+    this->fsm.cover(this->last);
+    this->row_count = count_rows();
 }
 
-// Close the physical file.
+// Close the physical file, writing back any dirty blocks first.
 void HeapFile::close(void)
 {
-    db.close(0);
-    closed = true;
+    if (this->closed)
+        return;
+    this->pool.reset(true);
+    save_meta();
+    this->fsm.close();
+    if (!this->lazy)
+        db.close(0);
+    this->closed = true;
+    this->lazy = false;
+}
+
+// Everything close() writes, without closing. Blocks go first so the metadata never counts one that isn't there.
+void HeapFile::flush(void)
+{
+    if (this->closed)
+        return;
+    this->pool.flush();
+    save_meta();
+    this->fsm.flush();
 }
 
 // Allocate a new block for the database file.
 // Returns the new empty DbBlock that is managing the records in this block and its block id.
-SlottedPage *HeapFile::get_new(void)
+// Usually the block is already in the file, so this only formats it in a (dirty) buffer frame.
+DbBlock *HeapFile::get_new(void)
 {
-    char block[DbBlock::BLOCK_SZ];
-    memset(block, 0, sizeof(block));
-    Dbt data(block, sizeof(block));
+    db_handle();
+    BlockID block_id = ++this->last;
+    if (block_id > this->allocated)
+        extend();
+    BufferFrame *frame = this->pool.pin_new(block_id);
+    DbBlock *page = new_block(frame->dbt, block_id, true);
+    frame->page = page;
+    this->fsm.set(block_id, page->get_free_space(), true);
+    return page;
+}
+
+// Like get_new() for a block the file already has: whatever was in it is never read.
+DbBlock *HeapFile::get_blank(BlockID block_id)
+{
+    db_handle();
+    BufferFrame *frame = this->pool.pin_new(block_id);
+    DbBlock *page = new_block(frame->dbt, block_id, true);
+    frame->page = page;
+    this->fsm.set(block_id, page->get_free_space(), true);
+    return page;
+}
+
+// The cached copies go first, so nothing writes them back afterwards. Berkeley DB's records are
+// deleted from the end, then it is asked to hand the pages they were on back to the file system.
+void HeapFile::truncate(BlockID last)
+{
+    if (last >= this->last)
+        return;
+    db_handle();
+    this->pool.discard(last);
+    for (BlockID block_id = this->allocated; block_id > last; block_id--)
+    {
+        Dbt key(&block_id, sizeof(block_id));
+        this->db.del(nullptr, &key, 0);
+    }
+    this->db.compact(nullptr, nullptr, nullptr, nullptr, DB_FREE_SPACE, nullptr);
+    this->last = this->allocated = last;
+    this->fsm.cover(last);
+    save_meta();
+}
 
-    int block_id = ++this->last;
-    Dbt key(&block_id, sizeof(block_id));
+// Add the next extent of zeroed blocks to the end of the file, in order, so Berkeley DB's records
+// always run from 1 to allocated and a block written back early never leaves a gap.
+void HeapFile::extend()
+{
+    std::vector<char> zeros(this->block_sz, 0);
+    Dbt data(zeros.data(), this->block_sz);
+    for (uint i = 0; i < EXTENT_BLOCKS; i++)
+    {
+        BlockID block_id = this->allocated + 1;
+        Dbt key(&block_id, sizeof(block_id));
+        this->db.put(nullptr, &key, &data, 0);
+        this->allocated = block_id;
+    }
+}
 
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage *page = new SlottedPage(data, this->last, true);
-    this->db.put(nullptr, &key, &data, 0); // write it out with initialization applied
-    this->db.get(nullptr, &key, &data, 0);
-    delete page;
-    return new SlottedPage(data, this->last); // Return a new SlottedPage
+// Every kind of page writes something into its header when it is formatted, so a block of all
+// zeros was never handed out.
+bool HeapFile::is_blank(const void *data, uint size)
+{
+    const char *bytes = (const char *)data;
+    return bytes[0] == 0 && memcmp(bytes, bytes + 1, size - 1) == 0;
 }
 
-// Get a block from the database file.
-SlottedPage *HeapFile::get(BlockID block_id)
+// Get a block from the database file. A cached block is just a lookup.
+DbBlock *HeapFile::get(BlockID block_id)
 {
-    Dbt key(&block_id, sizeof(block_id));
-    Dbt data;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, block_id, false); // Not a new one;
+    db_handle();
+    BufferFrame *frame = this->pool.pin(block_id);
+    if (frame->page == nullptr)
+        frame->page = new_block(frame->dbt, block_id, false); // Not a new one;
+    return frame->page;
 }
 
 // Write a block back to the database file.
-// put blockid into block.block...
+// Cached blocks are only marked dirty here and written back on eviction or close.
 void HeapFile::put(DbBlock *block)
 {
     BlockID block_id(block->get_block_id());
+    if (this->pool.mark_dirty(block_id))
+        return;
+    db_handle();
     Dbt blockid(&block_id, sizeof(block_id));
     this->db.put(nullptr, &blockid, block->get_block(), 0);
 }
 
-// Sequence of all block ids
+// Unpin a block obtained from get() or get_new().
+// Every change to a block happens while it is pinned, so this is where the free-space map catches up.
+void HeapFile::release(DbBlock *block)
+{
+    this->fsm.set(block->get_block_id(), block->get_free_space(), block->is_empty());
+    this->pool.unpin(block->get_block_id());
+}
+
+// Sequence of all block ids, less the ones the free-space map knows are empty
 BlockIDs *HeapFile::block_ids()
 {
     BlockIDs *id = new BlockIDs();
     for (BlockID i = 1; i <= this->last; i++)
     {
-        id->push_back(i);
+        if (!this->fsm.is_empty(i))
+            id->push_back(i);
     }
     return id;
 }
 
+// Advance block_id to the next block id (start from 0).
+bool HeapFile::next_block_id(BlockID &block_id)
+{
+    if (block_id >= this->last)
+    {
+        return false;
+    }
+    block_id++;
+    return true;
+}
+
 // Return the last block id
 // Already constructed in heap_storage.h
 // u_int32_t *HeapFile::get_last_block_id()
@@ -314,19 +651,106 @@ BlockIDs *HeapFile::block_ids()
 // Wrapper for Berkeley DB open, which does both open and creation.
 void HeapFile::db_open(uint flags)
 {
-    if (!this->closed)
+    if (!this->closed && !this->lazy)
     {
         return;
     }
-    this->db.set_re_len(DbBlock::BLOCK_SZ);
-    const char *path = nullptr;
-    _DB_ENV->get_home(&path);
-    this->dbfilename = "./" + this->name + ".db"; // Get a db::open Is a directory otherwise
+    if (flags & DB_CREATE)
+        this->db.set_re_len(this->block_sz); // otherwise Berkeley DB uses the length stored in the file
     this->db.open(nullptr, (this->dbfilename).c_str(), nullptr, DB_RECNO, flags, 0644);
+    u_int32_t re_len;
+    this->db.get_re_len(&re_len);
+    this->block_sz = re_len;
+    this->pool.set_block_size(this->block_sz);
+    this->fsm.set_block_size(this->block_sz);
+    this->closed = false;
+    this->lazy = false;
+}
+
+// Open the Berkeley DB file if open() put it off.
+void HeapFile::db_handle()
+{
+    if (this->lazy)
+        db_open();
+}
+
+// Work out the block count from the file itself, for files saved without metadata.
+void HeapFile::measure()
+{
     DB_BTREE_STAT *stat;
     this->db.stat(nullptr, &stat, DB_FAST_STAT);
-    this->last = flags ? 0 : stat->bt_ndata;
-    this->closed = false;
+    this->allocated = stat->bt_ndata;
+    free(stat);
+
+    // the rest of the last extent was never handed out
+    this->last = this->allocated;
+    std::vector<char> bytes(this->block_sz);
+    while (this->last > 0)
+    {
+        Dbt key(&this->last, sizeof(this->last));
+        Dbt data(bytes.data(), this->block_sz);
+        data.set_ulen(this->block_sz);
+        data.set_flags(DB_DBT_USERMEM);
+        if (this->db.get(nullptr, &key, &data, 0) != 0 || !is_blank(bytes.data(), this->block_sz))
+            break;
+        this->last--;
+    }
+}
+
+// Count the records block by block, for files saved without metadata.
+u_int64_t HeapFile::count_rows()
+{
+    u_int64_t rows = 0;
+    BlockID block_id = 0;
+    while (next_block_id(block_id))
+    {
+        DbBlock *block = get(block_id);
+        RecordID record_id = 0;
+        while (block->next_id(record_id))
+            rows++;
+        release(block);
+    }
+    return rows;
+}
+
+// Hand the counts to the free-space map, which saves them with its entries.
+void HeapFile::save_meta()
+{
+    HeapFileMeta meta;
+    meta.block_sz = this->block_sz;
+    meta.last = this->last;
+    meta.allocated = this->allocated;
+    meta.row_count = this->row_count;
+    this->fsm.set_meta(meta);
+}
+
+// Wrap a block's bytes in the kind of DbBlock this file uses.
+DbBlock *HeapFile::new_block(Dbt &data, BlockID block_id, bool is_new)
+{
+    return new SlottedPage(data, block_id, is_new);
+}
+
+/**
+ * @class RowLayout - where each column's field sits in a marshaled row
+ */
+
+// Offsets are worked out here only when they are the same for every row.
+RowLayout::RowLayout(const ColumnAttributes &column_attributes) : variable(false)
+{
+    u16 offset = 0;
+    for (ColumnAttribute ca : column_attributes)
+    {
+        this->data_types.push_back(ca.get_data_type());
+        this->fixed_offsets.push_back(offset);
+        if (ca.get_data_type() == ColumnAttribute::DataType::TEXT)
+            this->variable = true;
+        else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN)
+            offset += sizeof(u_int8_t);
+        else
+            offset += sizeof(int32_t);
+    }
+    if (this->variable)
+        this->fixed_offsets.clear();
 }
 
 /**
@@ -334,17 +758,23 @@ void HeapFile::db_open(uint flags)
  */
 
 // HeapTable constructor
-// Just size. Heapfile doesn't contians DB_BLOCK_SIZE
+// The table takes ownership of file; by default it is a Berkeley DB backed HeapFile.
 HeapTable::HeapTable(Identifier table_name, ColumnNames column_names,
-                     ColumnAttributes column_attributes) : DbRelation(table_name, column_names,
-                                                                      column_attributes),
-                                                           file(table_name) {}
+                     ColumnAttributes column_attributes, HeapFile *file) : DbRelation(table_name, column_names,
+                                                                                      column_attributes),
+                                                                           file(file != nullptr ? file : new HeapFile(table_name)),
+                                                                           layout(column_attributes) {}
+
+HeapTable::~HeapTable()
+{
+    delete this->file;
+}
 
 // Execute: CREATE TABLE <table_name> ( <columns> )
 // Is not responsible for metadata storage or validation.
 void HeapTable::create()
 {
-    file.create();
+    file->create();
 }
 
 // Execute: CREATE TABLE IF NOT EXISTS <table_name> ( <columns> )
@@ -365,19 +795,25 @@ void HeapTable::create_if_not_exists()
 // Execute: DROP TABLE <table_name>
 void HeapTable::drop()
 {
-    file.drop();
+    file->drop();
 }
 
 // Open existing table. Enables: insert, update, delete, select, project
 void HeapTable::open()
 {
-    file.open();
+    file->open();
 }
 
 // Closes the table. Disables: insert, update, delete, select, project
 void HeapTable::close()
 {
-    file.close();
+    file->close();
+}
+
+// Write back the file's dirty blocks; the table stays open.
+void HeapTable::flush()
+{
+    file->flush();
 }
 
 // Expect row to be a dictionary with column name keys.
@@ -386,226 +822,1089 @@ void HeapTable::close()
 Handle HeapTable::insert(const ValueDict *row)
 {
     open();
-    return Handle(append(validate(row)));
-}
-
-// Expect new_values to be a dictionary with column name keys.
-//  Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
-//  where handle is sufficient to identify one specific record (e.g., returned from an insert
-//  or select
-void HeapTable::update(const Handle handle, const ValueDict *new_values)
-{
-    throw DbRelationError("Not implemented");
+    Row full_row;
+    validate(row, full_row);
+    return append(full_row);
 }
 
-// Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
-//  where handle is sufficient to identify one specific record (e.g., returned from an insert
-//  or select).
-void HeapTable::del(const Handle handle)
+// Same, for a Row already bound to our columns: nothing to look up by name.
+Handle HeapTable::insert(const Row &row)
 {
     open();
-    BlockID block_id = handle.first;
-    RecordID record_id = handle.second;
-    SlottedPage *block = this->file.get(block_id);
-    block->del(record_id);
-    this->file.put(block);
-    delete block;
+    if (!row.fits(this->column_attributes))
+    {
+        throw DbRelationError("row does not match the columns of " + this->table_name);
+    }
+    return append(row);
 }
 
-// Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
-// Returns a list of handles for qualifying rows.
-Handles *HeapTable::select()
+// Insert many rows, marshaling each straight into a pinned block and only moving on to
+// another block when this one is full. Each block is written back once by the buffer pool
+// instead of once per row.
+Handles *HeapTable::insert_batch(const ValueDicts &rows)
 {
+    open();
     Handles *handles = new Handles();
-    BlockIDs *block_ids = file.block_ids();
-
-    for (auto const &block_id : *block_ids)
+    ScratchBuffer buffer(this->file->get_block_size());
+    char *bytes = buffer.data();
+    DbBlock *block = nullptr;
+    Row full_row; // reused, so its text buffer is only allocated once
+    try
     {
-        SlottedPage *block = file.get(block_id);
-        RecordIDs *record_ids = block->ids();
-        for (auto const &record_id : *record_ids)
+        for (auto const &row : rows)
         {
-            handles->push_back(Handle(block_id, record_id));
+            validate(row, full_row);
+            Dbt data(bytes, marshal(full_row, bytes));
+            u_int32_t size = data.get_size();
+            if (block != nullptr && block->get_free_space() < size)
+            {
+                this->file->put(block);
+                this->file->release(block);
+                block = nullptr;
+            }
+            if (block == nullptr)
+            {
+                block = room_for(size);
+            }
+            handles->push_back(Handle(block->get_block_id(), block->add(&data)));
+            this->file->rows_changed(1);
         }
-        delete record_ids;
-        delete block;
     }
-    delete block_ids;
-    return handles;
-}
-
-// Select the specific handles from where
-// Return a list of handles(rows)
-Handles *HeapTable::select(const ValueDict *where)
-{
-    Handles *handles = new Handles();
-    BlockIDs *block_ids = file.block_ids();
-
-    for (auto const &block_id : *block_ids)
+    catch (...)
     {
-        SlottedPage *block = file.get(block_id);
-        RecordIDs *record_ids = block->ids();
-        for (auto const &record_id : *record_ids)
+        if (block != nullptr)
         {
-            handles->push_back(Handle(block_id, record_id));
+            this->file->put(block); // keep the rows that did make it in
+            this->file->release(block);
         }
-        delete record_ids;
-        delete block;
+        delete handles;
+        throw;
+    }
+    if (block != nullptr)
+    {
+        this->file->put(block);
+        this->file->release(block);
     }
-    delete block_ids;
     return handles;
 }
 
-// Return all values for handle.
-ValueDict *HeapTable::project(Handle handle)
-{
-    return project(handle, &this->column_names);
-}
-
-// Return a sequence of values for handle given by column_names.
-ValueDict *HeapTable::project(Handle handle, const ColumnNames *column_names)
+// Expect new_values to be a dictionary with column name keys.
+//  Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
+//  where handle is sufficient to identify one specific record (e.g., returned from an insert
+//  or select
+// The record is rewritten where it is whenever it fits. If it doesn't, it moves to a block with room
+// and leaves a stub in its slot, so the handle (and any index entry holding it) stays good. A record
+// that has moved already goes back home if it fits there again, and otherwise on to another block,
+// so there is never more than one stub between a handle and its record.
+void HeapTable::update(const Handle handle, const ValueDict *new_values)
 {
-    // open(); Don't need to reopen
-    BlockID block_id = handle.first;
-    RecordID record_id = handle.second;
-    SlottedPage *block = file.get(block_id);
-    Dbt *data = block->get(record_id);
-    ValueDict *row = unmarshal(data);
-    if (column_names->empty())
-    {
-        return row;
-    }
-    ValueDict *result = new ValueDict();
-    for (auto const &column_name : *column_names)
+    open();
+    Row row;
+    project(handle, row);
+    for (auto const &value : *new_values)
     {
-        (*result)[column_name] = (*row)[column_name];
+        row.set(column_number(value.first), value.second);
     }
-    delete data;
-    delete block;
-    delete row;
-    return result;
-}
+    ScratchBuffer bytes(this->file->get_block_size());
+    Dbt data(bytes.data(), marshal(row, bytes.data()));
 
-// Check if the given row is acceptable to insert. Raise ValueError if not.
-// Otherwise return the full row dictionary.
-ValueDict *HeapTable::validate(const ValueDict *row)
-{
-    ValueDict *full_row = new ValueDict();
-    for (auto const &column_name : this->column_names)
+    DbBlock *block = this->file->get(handle.first);
+    DbBlock *moved = nullptr;
+    try
     {
-        Value value;
-        ValueDict::const_iterator it = row->find(column_name);
-        if (it == row->end())
+        Handle target;
+        if (!block->forwarded(handle.second, target))
         {
-            throw DbRelationError("don't know how to handle NULLs, defaults, etc.");
+            try
+            {
+                block->put(handle.second, data);
+            }
+            catch (DbBlockNoRoomError &e)
+            {
+                relocate(block, handle.second, data);
+            }
+            this->file->put(block);
         }
         else
         {
-            value = it->second;
+            moved = this->file->get(target.first);
+            try
+            {
+                moved->put(target.second, data);
+                this->file->put(moved);
+            }
+            catch (DbBlockNoRoomError &e)
+            {
+                try
+                {
+                    block->put(handle.second, data); // there's room at home again
+                }
+                catch (DbBlockNoRoomError &e)
+                {
+                    relocate(block, handle.second, data);
+                }
+                this->file->put(block);
+                moved->del(target.second);
+                this->file->put(moved);
+            }
         }
-        (*full_row)[column_name] = value;
     }
-    return full_row;
+    catch (...)
+    {
+        if (moved != nullptr)
+            this->file->release(moved);
+        this->file->release(block);
+        throw;
+    }
+    if (moved != nullptr)
+        this->file->release(moved);
+    this->file->release(block);
 }
 
-// Assumes row is fully fleshed-out. Appends a record to the file.
-Handle HeapTable::append(const ValueDict *row)
+// Put a record that no longer fits in its block into one with room and turn its slot into a stub.
+// If the stub can't be written either, the new copy is taken out again and nothing has changed.
+void HeapTable::relocate(DbBlock *block, RecordID record_id, const Dbt &data)
 {
-    Dbt *data = marshal(row);
-    SlottedPage *block = this->file.get(this->file.get_last_block_id());
-    RecordID recordID;
+    DbBlock *moved = room_for(data.get_size());
+    RecordID moved_id = 0;
     try
     {
-        recordID = block->add(data);
+        moved_id = moved->add_moved(&data);
+        block->forward(record_id, Handle(moved->get_block_id(), moved_id));
     }
-    catch (DbBlockNoRoomError &e)
+    catch (...)
     {
-        // need a new block
-        delete block;
-        block = this->file.get_new();
-        recordID = block->add(data);
+        if (moved_id != 0)
+            moved->del(moved_id);
+        this->file->release(moved);
+        throw;
     }
-
-    this->file.put(block);
-    delete block;
-    delete[](char *) data->get_data();
-    delete data;
-    return Handle(this->file.get_last_block_id(), recordID);
+    this->file->put(moved);
+    this->file->release(moved);
 }
 
-// return the bits to go into the file
-// caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
-Dbt *HeapTable::marshal(const ValueDict *row)
-{
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &column_name : this->column_names)
-    {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT)
-        {
-            *(int32_t *)(bytes + offset) = value.n;
-            offset += sizeof(int32_t);
+// Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
+//  where handle is sufficient to identify one specific record (e.g., returned from an insert
+//  or select).
+void HeapTable::del(const Handle handle)
+{
+    open();
+    BlockID block_id = handle.first;
+    RecordID record_id = handle.second;
+    DbBlock *block = this->file->get(block_id);
+    RecordView record;
+    Handle target;
+    if (block->view(record_id, record))
+    {
+        block->del(record_id);
+        this->file->put(block);
+        this->file->rows_changed(-1);
+    }
+    else if (block->forwarded(record_id, target))
+    {
+        DbBlock *moved = this->file->get(target.first);
+        moved->del(target.second);
+        this->file->put(moved);
+        this->file->release(moved);
+        block->del(record_id);
+        this->file->put(block);
+        this->file->rows_changed(-1);
+    }
+    this->file->release(block);
+}
+
+// Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+// Returns a list of handles for qualifying rows.
+Handles *HeapTable::select()
+{
+    return select(nullptr);
+}
+
+// Select the specific handles from where
+// Return a list of handles(rows)
+Handles *HeapTable::select(const ValueDict *where)
+{
+    return select(where, 1);
+}
+
+// Same as select(where), with the blocks shared out among up to parallelism threads.
+Handles *HeapTable::select(const ValueDict *where, uint parallelism)
+{
+    BlockFilter filter;
+    compile(where, filter);
+    return filter_blocks(filter, parallelism);
+}
+
+// The comparison goes to filter_ints(); any predicate on the same column in where is checked as well.
+Handles *HeapTable::select(const Identifier &column_name, const IntComparison &comparison, const ValueDict *where,
+                           uint parallelism)
+{
+    BlockFilter filter;
+    compile(where, filter.predicates);
+    filter.col_num = column_number(column_name);
+    if (this->column_attributes[filter.col_num].get_data_type() != ColumnAttribute::DataType::INT)
+    {
+        throw DbRelationError("can only compare INT column " + column_name);
+    }
+    filter.comparison = comparison;
+    return filter_blocks(filter, parallelism);
+}
+
+// Collect the handles of the rows that pass, morsel by morsel, and put them back together in block order.
+Handles *HeapTable::filter_blocks(const BlockFilter &filter, uint parallelism)
+{
+    BlockID last = this->file->get_last_block_id();
+    std::vector<Handles> found((last + MORSEL_BLOCKS - 1) / MORSEL_BLOCKS);
+    for_each_block(last, parallelism, [&](DbBlock *block, BlockID block_id, uint morsel)
+                   { filter_block(block, block_id, filter, found[morsel]); });
+
+    Handles *handles = new Handles();
+    for (auto const &morsel : found)
+        handles->insert(handles->end(), morsel.begin(), morsel.end());
+    return handles;
+}
+
+// Morsel-driven scan: each thread takes the next MORSEL_BLOCKS blocks until there are none left. With one
+// thread the morsels are just taken in order here, each one read ahead as a whole where the file can.
+void HeapTable::for_each_block(BlockID last, uint parallelism, const BlockVisitor &visit)
+{
+    uint morsels = (last + MORSEL_BLOCKS - 1) / MORSEL_BLOCKS;
+    WorkerPool &pool = WorkerPool::shared();
+    if (parallelism == 0)
+        parallelism = pool.get_size() + 1;
+    parallelism = std::max(std::min(parallelism, std::min(morsels, pool.get_size() + 1)), 1U);
+
+    std::atomic<uint> next_morsel(0);
+    pool.run(parallelism, [&]()
+             {
+                 uint morsel;
+                 while ((morsel = next_morsel++) < morsels)
+                 {
+                     BlockID first = morsel * MORSEL_BLOCKS + 1;
+                     BlockID end = std::min(first + MORSEL_BLOCKS - 1, last);
+                     std::unique_lock<std::mutex> guard(this->file_lock);
+                     this->file->prefetch(first, end - first + 1);
+                     for (BlockID block_id = first; block_id <= end; block_id++)
+                     {
+                         if (this->file->is_empty(block_id))
+                             continue;
+                         DbBlock *block = this->file->get(block_id);
+                         guard.unlock();
+                         try
+                         {
+                             visit(block, block_id, morsel);
+                         }
+                         catch (...)
+                         {
+                             next_morsel = morsels; // the others stop after their current morsel
+                             guard.lock();
+                             this->file->release(block);
+                             throw;
+                         }
+                         guard.lock();
+                         this->file->release(block);
+                     }
+                 } });
+}
+
+// Decode the rows that pass while their block is still pinned, so no handles are kept and no block is read twice.
+ValueDicts *HeapTable::scan(const ValueDict *where, const ColumnNames *column_names, uint parallelism)
+{
+    if (column_names == nullptr)
+        column_names = &this->column_names;
+    BlockFilter filter;
+    compile(where, filter);
+    BlockID last = this->file->get_last_block_id();
+    std::vector<ValueDicts> found((last + MORSEL_BLOCKS - 1) / MORSEL_BLOCKS);
+    try
+    {
+        for_each_block(last, parallelism, [&](DbBlock *block, BlockID block_id, uint morsel)
+                       {
+                           Handles hits;
+                           filter_block(block, block_id, filter, hits);
+                           RecordView record;
+                           DbBlock *moved;
+                           for (auto const &hit : hits)
+                           {
+                               if (!locate(block, hit.second, record, moved))
+                                   continue;
+                               try
+                               {
+                                   found[morsel].push_back(unmarshal(record, column_names));
+                               }
+                               catch (...)
+                               {
+                                   unpin(moved);
+                                   throw;
+                               }
+                               unpin(moved);
+                           } });
+    }
+    catch (...)
+    {
+        for (auto const &morsel : found)
+            for (auto row : morsel)
+                delete row;
+        throw;
+    }
+
+    ValueDicts *rows = new ValueDicts();
+    for (auto const &morsel : found)
+        rows->insert(rows->end(), morsel.begin(), morsel.end());
+    return rows;
+}
+
+// Add the handles of the block's records that pass the filter. The INT column, if there is one, is
+// gathered and checked for the whole block first; only its survivors get the record-by-record checks.
+void HeapTable::filter_block(DbBlock *block, BlockID block_id, const BlockFilter &filter, Handles &handles)
+{
+    if (filter.col_num < 0)
+    {
+        RecordID record_id = 0;
+        while (block->next_id(record_id))
+            if (filter.predicates.empty() || selected(block, record_id, filter.predicates))
+                handles.push_back(Handle(block_id, record_id));
+        return;
+    }
+    std::vector<RecordID> record_ids;
+    std::vector<int32_t> values;
+    gather(block, filter.col_num, record_ids, values);
+    std::vector<u_int64_t> selection((values.size() + 63) / 64);
+    filter_ints(values.data(), values.size(), filter.comparison, selection.data());
+    for (uint i = 0; i < record_ids.size(); i++)
+    {
+        if ((selection[i / 64] >> (i % 64) & 1) == 0)
+            continue;
+        if (filter.predicates.empty() || selected(block, record_ids[i], filter.predicates))
+            handles.push_back(Handle(block_id, record_ids[i]));
+    }
+}
+
+// Same as select(where), but the handles are found one at a time as the caller asks for them.
+DbRelationCursor *HeapTable::cursor(const ValueDict *where)
+{
+    return new HeapTableCursor(*this, where);
+}
+
+// Return all values for handle.
+ValueDict *HeapTable::project(Handle handle)
+{
+    return project(handle, &this->column_names);
+}
+
+// Return a sequence of values for handle given by column_names.
+// Only the asked-for columns are decoded.
+ValueDict *HeapTable::project(Handle handle, const ColumnNames *column_names)
+{
+    // open(); Don't need to reopen
+    BlockID block_id = handle.first;
+    RecordID record_id = handle.second;
+    DbBlock *block = file->get(block_id);
+    DbBlock *moved;
+    RecordView record;
+    if (!locate(block, record_id, record, moved))
+    {
+        file->release(block);
+        throw DbRelationError("record has been deleted");
+    }
+    ValueDict *row;
+    try
+    {
+        row = unmarshal(record, column_names);
+    }
+    catch (...)
+    {
+        unpin(moved);
+        file->release(block);
+        throw;
+    }
+    unpin(moved);
+    file->release(block);
+    return row;
+}
+
+// Decode all of a row into a Row, without building a ValueDict.
+void HeapTable::project(Handle handle, Row &row)
+{
+    DbBlock *block = file->get(handle.first);
+    DbBlock *moved;
+    RecordView record;
+    if (!locate(block, handle.second, record, moved))
+    {
+        file->release(block);
+        throw DbRelationError("record has been deleted");
+    }
+    unmarshal(record, row);
+    unpin(moved);
+    file->release(block);
+}
+
+// Visit the handles in block order so each block is pinned once, however many of its rows are asked for,
+// and put each row back where its handle was.
+ValueDicts *HeapTable::project_many(const Handles &handles, const ColumnNames *column_names)
+{
+    if (column_names == nullptr)
+        column_names = &this->column_names;
+    std::vector<uint> order(handles.size());
+    for (uint i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&handles](uint a, uint b)
+              { return handles[a] < handles[b]; });
+
+    ValueDicts *rows = new ValueDicts(handles.size(), nullptr);
+    DbBlock *block = nullptr;
+    try
+    {
+        for (uint i : order)
+        {
+            if (block == nullptr || block->get_block_id() != handles[i].first)
+            {
+                if (block != nullptr)
+                    this->file->release(block);
+                block = nullptr;
+                block = this->file->get(handles[i].first);
+            }
+            RecordView record;
+            DbBlock *moved;
+            if (!locate(block, handles[i].second, record, moved))
+                throw DbRelationError("record has been deleted");
+            try
+            {
+                (*rows)[i] = unmarshal(record, column_names);
+            }
+            catch (...)
+            {
+                unpin(moved);
+                throw;
+            }
+            unpin(moved);
+        }
+    }
+    catch (...)
+    {
+        if (block != nullptr)
+            this->file->release(block);
+        for (auto row : *rows)
+            delete row;
+        delete rows;
+        throw;
+    }
+    if (block != nullptr)
+        this->file->release(block);
+    return rows;
+}
+
+// Rewrite the rows, in handle order, into blocks 1, 2, ... and truncate the file after the last one used.
+// Each block's rows are copied out before anything is written, and only blocks already copied are
+// formatted again, so the rows waiting to be written are never much more than a block.
+// A stub is replaced by its record, so rows that moved come home. The record is read through the stub
+// if its block is still ahead; if its block has been copied already, the record was kept aside then
+// (any moved record whose stub hadn't been reached yet is).
+// Not safe against a crash part way through: a row only copied at the time would be lost.
+Relocations *HeapTable::vacuum()
+{
+    open();
+    BlockID last = this->file->get_last_block_id();
+    Relocations *moves = new Relocations();
+    std::vector<char> bytes;                           // the rows waiting to be written, back to back
+    std::vector<std::pair<Handle, u_int32_t>> waiting; // (old handle, size) of each of them
+    std::map<Handle, std::string> kept;                // moved records whose block went before their stub's
+    std::set<Handle> fetched;                          // moved records already read through their stub
+    DbBlock *out = nullptr;
+    BlockID out_id = 0;
+
+    auto copy = [&](Handle handle, const RecordView &record)
+    {
+        waiting.push_back(std::make_pair(handle, record.size));
+        bytes.insert(bytes.end(), record.data, record.data + record.size);
+    };
+
+    // Write as many of the waiting rows as fit in the blocks up to limit.
+    auto drain = [&](BlockID limit)
+    {
+        size_t offset = 0, done = 0;
+        while (done < waiting.size())
+        {
+            if (out == nullptr)
+            {
+                if (out_id >= limit)
+                    break;
+                out = ++out_id <= last ? this->file->get_blank(out_id) : this->file->get_new();
+                out_id = out->get_block_id();
+            }
+            Dbt data(bytes.data() + offset, waiting[done].second);
+            RecordID record_id;
+            try
+            {
+                record_id = out->add(&data);
+            }
+            catch (DbBlockNoRoomError &e)
+            {
+                if (out->is_empty())
+                    throw; // can't happen: it was in a block like this one before
+                this->file->put(out);
+                this->file->release(out);
+                out = nullptr;
+                continue;
+            }
+            Handle handle(out_id, record_id);
+            if (handle != waiting[done].first)
+                moves->push_back(std::make_pair(waiting[done].first, handle));
+            offset += waiting[done].second;
+            done++;
+        }
+        waiting.erase(waiting.begin(), waiting.begin() + done);
+        bytes.erase(bytes.begin(), bytes.begin() + offset);
+    };
+
+    try
+    {
+        for (BlockID block_id = 1; block_id <= last; block_id++)
+        {
+            if (!this->file->is_empty(block_id))
+            {
+                DbBlock *block = this->file->get(block_id);
+                try
+                {
+                    RecordID record_id = 0;
+                    RecordView record;
+                    Handle target;
+                    while (block->next_id(record_id))
+                    {
+                        Handle handle(block_id, record_id);
+                        if (block->view(record_id, record))
+                        {
+                            copy(handle, record);
+                            continue;
+                        }
+                        if (!block->forwarded(record_id, target))
+                            continue;
+                        auto it = kept.find(target);
+                        if (it != kept.end())
+                        {
+                            copy(handle, RecordView(it->second.data(), it->second.size()));
+                            kept.erase(it);
+                        }
+                        else if (target.first >= block_id)
+                        {
+                            assert(target.first != block_id); // records only move out, so a view per page
+                            DbBlock *moved = this->file->get(target.first);
+                            if (moved->view(target.second, record))
+                                copy(handle, record);
+                            this->file->release(moved);
+                            fetched.insert(target);
+                        }
+                    }
+                    record_id = 0;
+                    while (block->next_moved(record_id))
+                    {
+                        Handle handle(block_id, record_id);
+                        if (fetched.erase(handle) == 0 && block->view(record_id, record))
+                            kept[handle] = std::string(record.data, record.size);
+                    }
+                }
+                catch (...)
+                {
+                    this->file->release(block);
+                    throw;
+                }
+                this->file->release(block);
+            }
+            drain(block_id);
         }
-        else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT)
+        drain(UINT32_MAX);
+        if (out == nullptr && out_id == 0)
+            out = this->file->get_blank(++out_id); // no rows at all, but a file always has its first block
+    }
+    catch (...)
+    {
+        if (out != nullptr)
+            this->file->release(out);
+        delete moves;
+        throw;
+    }
+    if (out != nullptr)
+    {
+        this->file->put(out);
+        this->file->release(out);
+    }
+    this->file->truncate(out_id);
+    return moves;
+}
+
+// Check if the given row is acceptable to insert. Raise DbRelationError if not.
+// Otherwise fill in full_row, in column order.
+void HeapTable::validate(const ValueDict *row, Row &full_row)
+{
+    to_row(*row, full_row);
+}
+
+// Assumes row is fully fleshed-out. Appends a record to the file.
+Handle HeapTable::append(const Row &row)
+{
+    ScratchBuffer bytes(this->file->get_block_size()); // more than we need (we insist that one row fits into a block)
+    Dbt data(bytes.data(), marshal(row, bytes.data()));
+    DbBlock *block = room_for(data.get_size());
+    RecordID recordID;
+    try
+    {
+        recordID = block->add(&data);
+    }
+    catch (DbBlockNoRoomError &e)
+    {
+        // doesn't even fit in an empty block
+        this->file->release(block);
+        throw;
+    }
+
+    this->file->put(block);
+    this->file->rows_changed(1);
+    Handle handle(block->get_block_id(), recordID);
+    this->file->release(block);
+    return handle;
+}
+
+// Pin the first block the free-space map says has room for a size-byte record, or a new block if none does.
+// A block's get_free_space() already allows for whatever per-record overhead it has.
+DbBlock *HeapTable::room_for(u_int32_t size)
+{
+    BlockID block_id;
+    while ((block_id = this->file->find_room(size)) != 0)
+    {
+        DbBlock *block = this->file->get(block_id);
+        if (block->get_free_space() >= size)
         {
-            uint size = value.s.length();
+            return block;
+        }
+        this->file->release(block); // map was out of date; releasing the block corrects it
+    }
+    return this->file->get_new();
+}
+
+// return the bits to go into the file
+// caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
+Dbt *HeapTable::marshal(const ValueDict *row)
+{
+    ScratchBuffer bytes(this->file->get_block_size()); // more than we need (we insist that one row fits into a block)
+    uint offset = marshal(row, bytes.data());
+    char *right_size_bytes = new char[offset];
+    memcpy(right_size_bytes, bytes.data(), offset);
+    return new Dbt(right_size_bytes, offset);
+}
+
+// Write the bits for row into bytes (which must hold a whole block). Return how many were used.
+u_int32_t HeapTable::marshal(const ValueDict *row, char *bytes)
+{
+    Row full_row;
+    to_row(*row, full_row);
+    return marshal(full_row, bytes);
+}
+
+// The layout is described with RowLayout.
+u_int32_t HeapTable::marshal(const Row &row, char *bytes)
+{
+    uint offset = this->layout.header_size();
+    for (uint col_num = 0; col_num < row.size(); col_num++)
+    {
+        if (this->layout.is_variable())
+            ((u16 *)bytes)[col_num] = offset;
+        switch (row.get_data_type(col_num))
+        {
+        case ColumnAttribute::DataType::INT:
+            *(int32_t *)(bytes + offset) = row.get_int(col_num);
+            offset += sizeof(int32_t);
+            break;
+        case ColumnAttribute::DataType::TEXT:
+        {
+            uint size = row.get_text_size(col_num);
             *(u16 *)(bytes + offset) = size;
             offset += sizeof(u16);
-            memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
+            memcpy(bytes + offset, row.get_text_data(col_num), size); // assume ascii for now
             offset += size;
+            break;
         }
-        else
+        case ColumnAttribute::DataType::BOOLEAN:
+            *(u_int8_t *)(bytes + offset) = row.get_boolean(col_num);
+            offset += sizeof(u_int8_t);
+            break;
+        default:
+            throw DbRelationError("Only know how to marshal INT, TEXT and BOOLEAN");
+        }
+    }
+    return offset;
+}
+
+// Similar structure of marshal
+ValueDict *HeapTable::unmarshal(Dbt *data)
+{
+    return unmarshal(RecordView((const char *)data->get_data(), data->get_size()));
+}
+
+// Decode the fields straight out of the record's bytes (normally still sitting in a pinned block).
+ValueDict *HeapTable::unmarshal(const RecordView &record)
+{
+    ValueDict *row = new ValueDict();
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+    {
+        (*row)[this->column_names[col_num]] = unmarshal(record, col_num);
+    }
+    return row;
+}
+
+// Decode just the given columns (all of them if column_names is nullptr or empty).
+ValueDict *HeapTable::unmarshal(const RecordView &record, const ColumnNames *column_names)
+{
+    if (column_names == nullptr || column_names->empty())
+    {
+        return unmarshal(record);
+    }
+    ValueDict *row = new ValueDict();
+    try
+    {
+        for (auto const &column_name : *column_names)
+        {
+            (*row)[column_name] = unmarshal(record, column_number(column_name));
+        }
+    }
+    catch (...)
+    {
+        delete row;
+        throw;
+    }
+    return row;
+}
+
+// Decode one field, found through the row's offsets.
+Value HeapTable::unmarshal(const RecordView &record, uint col_num)
+{
+    const char *bytes = record.data + this->layout.field_offset(record.data, col_num);
+    Value value;
+    switch (this->column_attributes[col_num].get_data_type())
+    {
+    case ColumnAttribute::DataType::INT:
+        value.n = *(int32_t *)bytes;
+        break;
+    case ColumnAttribute::DataType::TEXT:
+        value.data_type = ColumnAttribute::TEXT;
+        value.s.assign(bytes + sizeof(u16), *(u16 *)bytes); // assume ascii for now
+        break;
+    case ColumnAttribute::DataType::BOOLEAN:
+        value.data_type = ColumnAttribute::BOOLEAN;
+        value.n = *(u_int8_t *)bytes;
+        break;
+    default:
+        throw DbRelationError("Only know how to unmarshal INT, TEXT and BOOLEAN");
+    }
+    return value;
+}
+
+// Decode every field into row, which is bound to our columns if it isn't already.
+void HeapTable::unmarshal(const RecordView &record, Row &row)
+{
+    if (!row.fits(this->column_attributes))
+    {
+        row.bind(this->column_attributes);
+    }
+    row.clear_text();
+    for (uint col_num = 0; col_num < row.size(); col_num++)
+    {
+        const char *bytes = record.data + this->layout.field_offset(record.data, col_num);
+        switch (row.get_data_type(col_num))
+        {
+        case ColumnAttribute::DataType::INT:
+            row.set_int(col_num, *(int32_t *)bytes);
+            break;
+        case ColumnAttribute::DataType::TEXT:
+            row.set_text(col_num, bytes + sizeof(u16), *(u16 *)bytes);
+            break;
+        case ColumnAttribute::DataType::BOOLEAN:
+            row.set_boolean(col_num, *(u_int8_t *)bytes);
+            break;
+        default:
+            throw DbRelationError("Only know how to unmarshal INT, TEXT and BOOLEAN");
+        }
+    }
+}
+
+// Position of column_name in our columns.
+uint HeapTable::column_number(const Identifier &column_name)
+{
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+    {
+        if (this->column_names[col_num] == column_name)
+        {
+            return col_num;
+        }
+    }
+    throw DbRelationError("unknown column " + column_name);
+}
+
+// Line the where-clause values up with our columns: predicates[i] is the value column i must equal,
+// or nullptr if column i is unconstrained. Trailing unconstrained columns are left off.
+void HeapTable::compile(const ValueDict *where, Predicates &predicates)
+{
+    predicates.clear();
+    if (where == nullptr || where->empty())
+    {
+        return;
+    }
+    predicates.resize(this->column_names.size(), nullptr);
+    uint found = 0;
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+    {
+        ValueDict::const_iterator it = where->find(this->column_names[col_num]);
+        if (it != where->end())
+        {
+            // selected() compares the raw field, so a TEXT value against an INT column (or vice versa) would
+            // otherwise be read as 0 or garbage
+            bool text_column = this->column_attributes[col_num].get_data_type() == ColumnAttribute::DataType::TEXT;
+            if (text_column != (it->second.data_type == ColumnAttribute::DataType::TEXT))
+                throw DbRelationError("wrong type in where clause for column " + this->column_names[col_num]);
+            predicates[col_num] = &it->second;
+            found++;
+        }
+    }
+    if (found != where->size())
+    {
+        throw DbRelationError("unknown column in where clause");
+    }
+    while (predicates.back() == nullptr)
+    {
+        predicates.pop_back();
+    }
+}
+
+// Check the record's marshaled bytes against the compiled where-clause without building a ValueDict.
+// Only the constrained columns are looked at, and it stops at the first one that doesn't match.
+bool HeapTable::selected(const RecordView &record, const Predicates &predicates)
+{
+    for (uint col_num = 0; col_num < predicates.size(); col_num++)
+    {
+        const Value *value = predicates[col_num];
+        if (value == nullptr)
+        {
+            continue;
+        }
+        const char *bytes = record.data + this->layout.field_offset(record.data, col_num);
+        switch (this->column_attributes[col_num].get_data_type())
         {
-            throw DbRelationError("Only know how to marshal INT and TEXT");
+        case ColumnAttribute::DataType::INT:
+            if (*(int32_t *)bytes != value->n)
+                return false;
+            break;
+        case ColumnAttribute::DataType::TEXT:
+        {
+            u16 size = *(u16 *)bytes;
+            if (size != value->s.length() || memcmp(bytes + sizeof(u16), value->s.data(), size) != 0)
+                return false;
+            break;
+        }
+        case ColumnAttribute::DataType::BOOLEAN:
+            if (*(u_int8_t *)bytes != (value->n != 0))
+                return false;
+            break;
+        default:
+            throw DbRelationError("Only know how to compare INT, TEXT and BOOLEAN");
         }
     }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    delete[] bytes;
-    return data;
+    return true;
+}
+
+// Same as compile(where, predicates), but the first INT equality is taken out to be checked a page at a time.
+void HeapTable::compile(const ValueDict *where, BlockFilter &filter)
+{
+    compile(where, filter.predicates);
+    filter.col_num = -1;
+    Predicates &predicates = filter.predicates;
+    for (uint col_num = 0; col_num < predicates.size(); col_num++)
+    {
+        if (predicates[col_num] != nullptr &&
+            this->column_attributes[col_num].get_data_type() == ColumnAttribute::DataType::INT)
+        {
+            filter.col_num = col_num;
+            filter.comparison = IntComparison(IntComparison::EQ, predicates[col_num]->n);
+            predicates[col_num] = nullptr;
+            break;
+        }
+    }
+    while (!predicates.empty() && predicates.back() == nullptr)
+    {
+        predicates.pop_back();
+    }
+}
+
+// Copy one INT column of the block's records into values, lined up with their ids in record_ids.
+// Blocks that keep a column together are handled by overriding this.
+void HeapTable::gather(DbBlock *block, uint col_num, std::vector<RecordID> &record_ids, std::vector<int32_t> &values)
+{
+    RecordID record_id = 0;
+    RecordView record;
+    DbBlock *moved;
+    while (block->next_id(record_id))
+    {
+        if (!locate(block, record_id, record, moved))
+            continue;
+        record_ids.push_back(record_id);
+        values.push_back(*(int32_t *)(record.data + this->layout.field_offset(record.data, col_num)));
+        unpin(moved);
+    }
+}
+
+// Check a record, still in its pinned block, against the compiled where-clause.
+// Blocks that can reach single columns directly are handled by overriding this.
+bool HeapTable::selected(DbBlock *block, RecordID record_id, const Predicates &predicates)
+{
+    RecordView record;
+    if (block->view(record_id, record))
+        return selected(record, predicates);
+    DbBlock *moved;
+    if (!locate(block, record_id, record, moved))
+        return false;
+    bool passes;
+    try
+    {
+        passes = selected(record, predicates);
+    }
+    catch (...)
+    {
+        unpin(moved);
+        throw;
+    }
+    unpin(moved);
+    return passes;
+}
+
+// View a row through its handle's slot. If the slot holds a stub, the block the row moved to is
+// pinned and handed back in moved, for the caller to unpin() once done with record.
+bool HeapTable::locate(DbBlock *block, RecordID record_id, RecordView &record, DbBlock *&moved)
+{
+    moved = nullptr;
+    if (block->view(record_id, record))
+        return true;
+    Handle target;
+    if (!block->forwarded(record_id, target))
+        return false;
+    assert(target.first != block->get_block_id()); // records only move out, so a view per page
+    moved = pin(target.first);
+    if (moved->view(target.second, record))
+        return true;
+    unpin(moved);
+    moved = nullptr;
+    return false;
+}
+
+// Get a block while a parallel scan may be using the file from other threads.
+DbBlock *HeapTable::pin(BlockID block_id)
+{
+    std::lock_guard<std::mutex> guard(this->file_lock);
+    return this->file->get(block_id);
+}
+
+// Release a block from pin() (nullptr is fine).
+void HeapTable::unpin(DbBlock *block)
+{
+    if (block == nullptr)
+        return;
+    std::lock_guard<std::mutex> guard(this->file_lock);
+    this->file->release(block);
+}
+
+/**
+ * @class HeapTableCursor - scan of a HeapTable (implementation of DbRelationCursor)
+ */
+
+// The where-clause is compiled once here and then checked against each record in place.
+HeapTableCursor::HeapTableCursor(HeapTable &table, const ValueDict *where) : table(table), block(nullptr),
+                                                                            block_id(0), record_id(0), prefetched(0)
+{
+    this->table.compile(where, this->predicates);
+}
+
+// Unpin the block we stopped in, if any.
+HeapTableCursor::~HeapTableCursor()
+{
+    if (this->block != nullptr)
+    {
+        this->table.file->release(this->block);
+    }
 }
 
-// Similar structure of marshal
-ValueDict *HeapTable::unmarshal(Dbt *data)
+// Move to the next record, stepping into the next block when this one runs out.
+bool HeapTableCursor::next(Handle &handle)
 {
-    ValueDict *row = new ValueDict();
-    uint offset = 0;
-    uint col_num = 0;
-    char *bytes = (char *)data->get_data();
-    Value value; // New value
-
-    for (auto const &column_name : this->column_names)
+    while (true)
     {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT)
+        while (this->block != nullptr && this->block->next_id(this->record_id))
         {
-            value.n = *(int32_t *)(bytes + offset);
-            offset += sizeof(int32_t);
+            if (!this->predicates.empty() && !this->table.selected(this->block, this->record_id, this->predicates))
+            {
+                continue;
+            }
+            handle = Handle(this->block_id, this->record_id);
+            return true;
         }
-        else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT)
+        if (this->block != nullptr)
         {
-            u16 size = *(u16 *)(bytes + offset);
-            offset += sizeof(u16);
-            char buffer[size];
-            memcpy(buffer, bytes + offset, size); // Idea from marshal
-            buffer[size] = (char)0;
-            value.s = string(buffer); // assume ascii for now
-            offset += size;
+            this->table.file->release(this->block);
+            this->block = nullptr;
         }
-        else
+        if (!this->table.file->next_block_id(this->block_id))
+        {
+            return false;
+        }
+        if (this->block_id + READ_AHEAD / 2 > this->prefetched)
         {
-            throw DbRelationError("Only know how to marshal INT and TEXT");
+            // keep at least half a window of blocks on their way in
+            BlockID first = std::max(this->prefetched + 1, this->block_id);
+            uint count = this->block_id + READ_AHEAD - first;
+            this->table.file->prefetch(first, count);
+            this->prefetched = first + count - 1;
         }
-        (*row)[column_name] = value;
+        if (this->table.file->is_empty(this->block_id))
+        {
+            continue;
+        }
+        this->block = this->table.file->get(this->block_id);
+        this->record_id = 0;
+    }
+}
+
+// Decode the current record while its block is still pinned.
+ValueDict *HeapTableCursor::project(const ColumnNames *column_names)
+{
+    RecordView record;
+    DbBlock *moved;
+    if (this->block == nullptr || !this->table.locate(this->block, this->record_id, record, moved))
+    {
+        throw DbRelationError("cursor is not on a row");
+    }
+    ValueDict *row;
+    try
+    {
+        row = this->table.unmarshal(record, column_names);
+    }
+    catch (...)
+    {
+        this->table.unpin(moved);
+        throw;
     }
+    this->table.unpin(moved);
     return row;
 }
 
+// Decode the whole current record into row while its block is still pinned.
+void HeapTableCursor::project(Row &row)
+{
+    RecordView record;
+    DbBlock *moved;
+    if (this->block == nullptr || !this->table.locate(this->block, this->record_id, record, moved))
+    {
+        throw DbRelationError("cursor is not on a row");
+    }
+    this->table.unmarshal(record, row);
+    this->table.unpin(moved);
+}
+
 // test function -- returns true if all tests pass
 bool test_heap_storage()
 {
@@ -650,9 +1949,628 @@ bool test_heap_storage()
         table.drop();
         return false;
     }
+
+    // only the row with a = 13 should be selected
+    row["a"] = Value(13);
+    row["b"] = Value("Bye!");
+    Handle second = table.insert(&row);
+    ValueDict where;
+    where["a"] = Value(13);
+    Handles *selected = table.select(&where);
+    bool filtered = selected->size() == 1 && (*selected)[0] == second;
+    delete selected;
+    where["b"] = Value("Hello!");
+    selected = table.select(&where);
+    filtered = filtered && selected->empty();
+    delete selected;
+    if (!filtered)
+    {
+        std::cout << "Wrong select with where" << std::endl;
+        table.drop();
+        return false;
+    }
+    table.del(second);
+
+    // projecting just the TEXT column should decode only that field
+    ColumnNames just_b;
+    just_b.push_back("b");
+    ValueDict *projected = table.project((*handles)[0], &just_b);
+    bool narrowed = projected->size() == 1 && (*projected)["b"].s == "Hello!";
+    delete projected;
+    if (!narrowed)
+    {
+        std::cout << "Wrong projected columns" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // a Row goes in and comes back out without any ValueDict
+    Row typed(column_attributes);
+    typed.set_int(0, 14);
+    typed.set_text(1, "typed", 5);
+    Handle typed_handle = table.insert(typed);
+    Row fetched;
+    table.project(typed_handle, fetched);
+    bool rowed = fetched.size() == 2 && fetched.get_int(0) == 14 && fetched.get_text(1) == "typed";
+    table.del(typed_handle);
+    if (!rowed)
+    {
+        std::cout << "Wrong Row insert/project" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // a Row left bound to another relation's columns of the same width gets rebound
+    ColumnAttributes swapped;
+    swapped.push_back(column_attributes[1]);
+    swapped.push_back(column_attributes[0]);
+    Row other(swapped);
+    other.set_text(0, "other", 5);
+    other.set_int(1, 15);
+    bool rejected = false;
+    try
+    {
+        table.insert(other);
+    }
+    catch (DbRelationError &)
+    {
+        rejected = true;
+    }
+    typed_handle = table.insert(typed);
+    table.project(typed_handle, other);
+    rowed = rejected && other.get_int(0) == 14 && other.get_text(1) == "typed";
+    table.del(typed_handle);
+    if (!rowed)
+    {
+        std::cout << "Wrong Row rebinding" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // a cursor should find the same single row
+    DbRelationCursor *cursor = table.cursor();
+    Handle handle;
+    bool found = cursor->next(handle) && handle == (*handles)[0];
+    if (found)
+    {
+        cursor->project(fetched);
+        found = fetched.get_int(0) == 12 && fetched.get_text(1) == "Hello!" && !cursor->next(handle);
+    }
+    delete cursor;
+    if (!found)
+    {
+        std::cout << "Wrong cursor rows" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // a batch should come back in order and fill blocks the same way single inserts do
+    HeapTable batch("_test_batch_cpp", column_names, column_attributes);
+    batch.create();
+    ValueDicts rows;
+    for (int i = 0; i < 1000; i++)
+    {
+        ValueDict *batch_row = new ValueDict();
+        (*batch_row)["a"] = Value(i);
+        (*batch_row)["b"] = Value("batch");
+        rows.push_back(batch_row);
+    }
+    Handles *batch_handles = batch.insert_batch(rows);
+    bool batched = batch_handles->size() == rows.size() && batch_handles->back().first > 1;
+    for (uint i = 0; batched && i < rows.size(); i += 97)
+    {
+        ValueDict *batch_row = batch.project((*batch_handles)[i]);
+        batched = (*batch_row)["a"].n == (int)i;
+        delete batch_row;
+    }
+    delete batch_handles;
+    batch.drop();
+    if (!batched)
+    {
+        for (auto batch_row : rows)
+            delete batch_row;
+        std::cout << "Wrong batch insert" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // the same rows kept in an mmap'ed page file instead of Berkeley DB
+    HeapTable mapped("_test_mmap_cpp", column_names, column_attributes, new MmapPageFile("_test_mmap_cpp"));
+    mapped.create();
+    Handles *mapped_handles = mapped.insert_batch(rows);
+    bool mapped_ok = mapped_handles->back().first > 1;
+    ValueDict *mapped_row = mapped.project(mapped_handles->back());
+    mapped_ok = mapped_ok && (*mapped_row)["a"].n == 999 && (*mapped_row)["b"].s == "batch";
+    delete mapped_row;
+    delete mapped_handles;
+    mapped.close();
+    {
+        // dropped without ever being opened, the page file should still go, so it can be made again
+        MmapPageFile unopened("_test_mmap_cpp");
+        unopened.drop();
+        MmapPageFile remade("_test_mmap_cpp");
+        try
+        {
+            remade.create();
+            remade.drop();
+        }
+        catch (DbException &e)
+        {
+            mapped_ok = false;
+        }
+    }
+    for (auto batch_row : rows)
+        delete batch_row;
+    if (!mapped_ok)
+    {
+        std::cout << "Wrong mmap page file rows" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // inserts while a statement's arena is current take their buffers from it and hand them back
+    {
+        Arena arena;
+        ArenaScope scope(arena);
+        row["a"] = Value(15);
+        Handle arena_handle = table.insert(&row);
+        bool rewound = arena.get_used() == 0;
+        table.del(arena_handle);
+        if (!rewound)
+        {
+            std::cout << "Wrong arena use for insert" << std::endl;
+            table.drop();
+            return false;
+        }
+    }
+
+    // fill past the first block, then space freed in block 1 should be reused
+    HeapTable churn("_test_churn_cpp", column_names, column_attributes);
+    churn.create();
+    Handle first = churn.insert(&row);
+    Handle next = churn.insert(&row);
+    Handle last = next;
+    while (last.first == first.first)
+        last = churn.insert(&row);
+    churn.del(first);
+    churn.del(next);
+    bool reused = churn.insert(&row).first == first.first;
+    churn.drop();
+    if (!reused)
+    {
+        std::cout << "Wrong block for insert after delete" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // a scan split among threads should find the same rows, in the same order, as one on this thread
+    HeapTable parallel("_test_parallel_cpp", column_names, column_attributes);
+    parallel.create();
+    ValueDict filler;
+    filler["b"] = Value(std::string(100, 'p'));
+    for (int i = 0; i < 1000; i++)
+    {
+        filler["a"] = Value(i % 7);
+        parallel.insert(&filler);
+    }
+    where.clear();
+    where["a"] = Value(3);
+    Handles *serial = parallel.select(&where);
+    Handles *split = parallel.select(&where, 4);
+    bool same = *serial == *split && serial->size() == 143 && serial->back().first > HeapTable::MORSEL_BLOCKS;
+    delete serial;
+    delete split;
+    split = parallel.select(nullptr, 0);
+    same = same && split->size() == 1000;
+    delete split;
+    if (!same)
+    {
+        std::cout << "Wrong parallel select" << std::endl;
+        parallel.drop();
+        table.drop();
+        return false;
+    }
+
+    // comparisons checked a page at a time: a < 2 is 2 rows in 7, 2 <= a <= 4 is 3, a > 5 is 1
+    split = parallel.select("a", IntComparison(IntComparison::LT, 2));
+    bool compared = split->size() == 286;
+    delete split;
+    split = parallel.select("a", IntComparison::between(2, 4), nullptr, 4);
+    compared = compared && split->size() == 429;
+    delete split;
+    where.clear();
+    where["b"] = Value(std::string(100, 'p'));
+    split = parallel.select("a", IntComparison(IntComparison::GT, 5), &where);
+    compared = compared && split->size() == 142;
+    delete split;
+    where["b"] = Value("nothing");
+    split = parallel.select("a", IntComparison(IntComparison::GT, 5), &where);
+    compared = compared && split->empty();
+    delete split;
+    if (!compared)
+    {
+        std::cout << "Wrong comparison select" << std::endl;
+        parallel.drop();
+        table.drop();
+        return false;
+    }
+
+    // a where-clause value of the wrong type is refused rather than compared as whatever bytes it has
+    int refused = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        where.clear();
+        where[i == 0 ? "a" : "b"] = i == 0 ? Value("3") : Value(3);
+        try
+        {
+            delete parallel.select(&where);
+        }
+        catch (DbRelationError &e)
+        {
+            refused++;
+        }
+    }
+    if (refused != 2)
+    {
+        std::cout << "Wrong where-clause type check" << std::endl;
+        parallel.drop();
+        table.drop();
+        return false;
+    }
+
+    // projecting many rows at once should give them back in the order asked for, not block order
+    split = parallel.select("a", IntComparison(IntComparison::EQ, 3));
+    std::reverse(split->begin(), split->end());
+    ColumnNames just_a(1, "a");
+    ValueDicts *many = parallel.project_many(*split, &just_a);
+    bool in_order = many->size() == split->size();
+    for (uint i = 0; in_order && i < many->size(); i++)
+    {
+        ValueDict *one = parallel.project((*split)[i]);
+        in_order = (*many)[i]->size() == 1 && (*(*many)[i])["a"] == (*one)["a"] && (*one)["a"].n == 3;
+        delete one;
+    }
+    for (auto many_row : *many)
+        delete many_row;
+    delete many;
+    delete split;
+    if (!in_order)
+    {
+        std::cout << "Wrong project_many" << std::endl;
+        parallel.drop();
+        table.drop();
+        return false;
+    }
+
+    // a one-pass scan should find the same rows, in the same order, as select() then project()
+    where.clear();
+    where["a"] = Value(5);
+    split = parallel.select(&where);
+    many = parallel.scan(&where, nullptr, 4);
+    bool one_pass = many->size() == split->size() && many->size() == 143;
+    for (uint i = 0; one_pass && i < many->size(); i++)
+    {
+        ValueDict *one = parallel.project((*split)[i]);
+        one_pass = *(*many)[i] == *one;
+        delete one;
+    }
+    for (auto many_row : *many)
+        delete many_row;
+    delete many;
+    delete split;
+    parallel.drop();
+    if (!one_pass)
+    {
+        std::cout << "Wrong scan" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // updates happen in place; a row that outgrows a full block moves, but its handle keeps working
+    HeapTable updated("_test_update_cpp", column_names, column_attributes);
+    updated.create();
+    filler["b"] = Value(std::string(90, 'u'));
+    Handles moving;
+    for (int i = 0; i < 60; i++)
+    {
+        filler["a"] = Value(i);
+        moving.push_back(updated.insert(&filler));
+    }
+    Handle home = moving[0];
+    ValueDict changes;
+    changes["b"] = Value(std::string(10, 'x'));
+    updated.update(home, &changes);
+    ValueDict *changed = updated.project(home);
+    bool in_place = (*changed)["a"].n == 0 && (*changed)["b"].s == std::string(10, 'x');
+    delete changed;
+    changes["b"] = Value(std::string(1500, 'y'));
+    updated.update(home, &changes);
+    changes.clear();
+    changes["a"] = Value(1000);
+    updated.update(home, &changes);
+    changed = updated.project(home);
+    in_place = in_place && (*changed)["a"].n == 1000 && (*changed)["b"].s == std::string(1500, 'y');
+    delete changed;
+    where.clear();
+    where["a"] = Value(1000);
+    Handles *kept = updated.select(&where);
+    in_place = in_place && kept->size() == 1 && (*kept)[0] == home;
+    delete kept;
+    kept = updated.select();
+    in_place = in_place && kept->size() == 60;
+    delete kept;
+    ValueDicts *scanned = updated.scan(&where);
+    in_place = in_place && scanned->size() == 1 && (*(*scanned)[0])["b"].s == std::string(1500, 'y');
+    for (auto scanned_row : *scanned)
+        delete scanned_row;
+    delete scanned;
+    updated.del(home);
+    kept = updated.select();
+    in_place = in_place && kept->size() == 59;
+    delete kept;
+    updated.drop();
+    if (!in_place)
+    {
+        std::cout << "Wrong update" << std::endl;
+        table.drop();
+        return false;
+    }
+
+    // scans pass by emptied blocks; vacuum() packs what is left (moved rows included) into the first few
+    // blocks, gives back the rest, and says where each row went
+    HeapFile *vacuum_file = new HeapFile("_test_vacuum_cpp");
+    HeapTable vacuumed("_test_vacuum_cpp", column_names, column_attributes, vacuum_file);
+    vacuumed.create();
+    filler["b"] = Value(std::string(90, 'v'));
+    Handles before;
+    for (int i = 0; i < 400; i++)
+    {
+        filler["a"] = Value(i);
+        before.push_back(vacuumed.insert(&filler));
+    }
+    changes.clear();
+    changes["b"] = Value(std::string(1500, 'y'));
+    vacuumed.update(before[210], &changes); // moves on, to a block further along
+    for (int i = 0; i < 200; i++)
+        vacuumed.del(before[i]);
+    changes["b"] = Value(std::string(3500, 'z'));
+    vacuumed.update(before[390], &changes); // moves back, to a block emptied above
+    for (int i = 200; i < 400; i++)
+        if (i % 10 != 0)
+            vacuumed.del(before[i]);
+    BlockID last_block = vacuum_file->get_last_block_id();
+    BlockIDs *live_blocks = vacuum_file->block_ids();
+    kept = vacuumed.select();
+    bool packed = live_blocks->size() < last_block && kept->size() == 20;
+    delete live_blocks;
+    delete kept;
+    Relocations *moves = vacuumed.vacuum();
+    std::map<Handle, Handle> after(moves->begin(), moves->end());
+    packed = packed && vacuum_file->get_last_block_id() < last_block && moves->size() <= 20;
+    for (int i = 200; i < 400 && packed; i += 10)
+    {
+        Handle handle = after.count(before[i]) ? after[before[i]] : before[i];
+        changed = vacuumed.project(handle);
+        uint size = i == 210 ? 1500 : i == 390 ? 3500 : 90;
+        packed = (*changed)["a"].n == i && (*changed)["b"].s.size() == size;
+        delete changed;
+    }
+    delete moves;
+    vacuumed.close();
+    vacuumed.open();
+    kept = vacuumed.select();
+    packed = packed && kept->size() == 20;
+    delete kept;
+    vacuumed.drop();
+    if (!packed)
+    {
+        std::cout << "Wrong vacuum" << std::endl;
+        table.drop();
+        return false;
+    }
+
     table.drop();
     delete result;
     delete handles;
+
+    // a table that is never closed loses nothing once it is flushed (as at the end of each statement),
+    // nor when the object just goes away
+    HeapTable *unclosed = new HeapTable("_test_unclosed_cpp", column_names, column_attributes);
+    unclosed->create();
+    for (int i = 0; i < 50; i++)
+    {
+        filler["a"] = Value(i);
+        unclosed->insert(&filler);
+    }
+    unclosed->flush();
+    HeapTable *reader = new HeapTable("_test_unclosed_cpp", column_names, column_attributes);
+    reader->open();
+    kept = reader->select();
+    bool written = kept->size() == 50;
+    delete kept;
+    delete reader;
+    filler["a"] = Value(50);
+    unclosed->insert(&filler);
+    delete unclosed;
+    HeapTable flushed("_test_unclosed_cpp", column_names, column_attributes);
+    flushed.open();
+    kept = flushed.select();
+    written = written && kept->size() == 51;
+    delete kept;
+    flushed.drop();
+    if (!written)
+    {
+        std::cout << "Wrong write-back" << std::endl;
+        return false;
+    }
+
+    // flushing metadata that hasn't changed (as after a statement that only reads) writes nothing
+    struct CountingMap : public FreeSpaceMap
+    {
+        int writes;
+        CountingMap() : FreeSpaceMap("_test_fsm_cpp"), writes(0) {}
+        void put_meta(const void *record)
+        {
+            this->writes++;
+            FreeSpaceMap::put_meta(record);
+        }
+    } counting;
+    counting.create();
+    HeapFileMeta meta = {DbBlock::BLOCK_SZ, 1, 1, 0};
+    counting.set_meta(meta);
+    counting.flush();
+    int after_change = counting.writes;
+    counting.set_meta(meta);
+    counting.flush();
+    bool quiet = counting.writes == after_change;
+    meta.row_count++;
+    counting.set_meta(meta);
+    counting.flush();
+    quiet = quiet && counting.writes == after_change + 2; // marked in use, then saved
+    counting.close();
+    if (!quiet)
+    {
+        counting.drop();
+        std::cout << "Wrong metadata writes" << std::endl;
+        return false;
+    }
+
+    // opening writes nothing; the first change marks the map in use once, and a map in use isn't trusted
+    counting.writes = 0;
+    HeapFileMeta loaded;
+    bool marked = counting.open(loaded) && loaded.row_count == meta.row_count && counting.writes == 0;
+    counting.set(1, 100);
+    counting.set(1, 50);
+    marked = marked && counting.writes == 1;
+    {
+        FreeSpaceMap other("_test_fsm_cpp");
+        marked = marked && !other.open(loaded);
+    }
+    counting.flush();
+    {
+        FreeSpaceMap other("_test_fsm_cpp");
+        marked = marked && other.open(loaded);
+    }
+    counting.drop();
+    // and a table that isn't there leaves no map behind
+    HeapTable missing("_test_missing_cpp", column_names, column_attributes);
+    try
+    {
+        missing.open();
+        marked = false;
+    }
+    catch (DbException &e)
+    {
+    }
+    try
+    {
+        FreeSpaceMap stray("_test_missing_cpp");
+        stray.open(loaded);
+        marked = false;
+    }
+    catch (DbException &e)
+    {
+    }
+    if (!marked)
+    {
+        std::cout << "Wrong metadata in use mark" << std::endl;
+        return false;
+    }
+
+    // blocks formatted in the pool by get_new(), over several extents, reach the file with the counts that go with them
+    HeapFile *growing = new HeapFile("_test_extents_cpp");
+    HeapTable *abandoned = new HeapTable("_test_extents_cpp", column_names, column_attributes, growing);
+    abandoned->create();
+    for (int i = 0; i < 1000; i++)
+    {
+        filler["a"] = Value(i);
+        abandoned->insert(&filler);
+    }
+    abandoned->flush(); // end of the statement; the object is never closed
+    HeapFile *regrown = new HeapFile("_test_extents_cpp");
+    HeapTable regrown_table("_test_extents_cpp", column_names, column_attributes, regrown);
+    regrown_table.open();
+    kept = regrown_table.select();
+    bool extended = growing->get_last_block_id() > 2 * HeapFile::EXTENT_BLOCKS && kept->size() == 1000 &&
+                    regrown->get_last_block_id() == growing->get_last_block_id() && regrown->get_row_count() == 1000;
+    delete kept;
+    delete abandoned;
+    regrown_table.drop();
+    if (!extended)
+    {
+        std::cout << "Wrong extents" << std::endl;
+        return false;
+    }
+
+    // a table opened from its saved metadata alone can be dropped: nothing is left behind to stop a new create()
+    HeapTable *dropping = new HeapTable("_test_lazy_drop_cpp", column_names, column_attributes);
+    dropping->create();
+    dropping->insert(&filler);
+    dropping->close();
+    delete dropping;
+    dropping = new HeapTable("_test_lazy_drop_cpp", column_names, column_attributes);
+    bool dropped = true;
+    try
+    {
+        dropping->open();
+        dropping->drop();
+        delete dropping;
+        dropping = new HeapTable("_test_lazy_drop_cpp", column_names, column_attributes);
+        dropping->create();
+        dropping->drop();
+    }
+    catch (DbException &e)
+    {
+        dropped = false;
+    }
+    delete dropping;
+    if (!dropped)
+    {
+        std::cout << "Wrong drop after open" << std::endl;
+        return false;
+    }
+
+    // the block made by create() is still cached, so fetching it should never go back to the file
+    HeapFile file("_test_pool_cpp");
+    file.create();
+    file.release(file.get(1));
+    file.release(file.get(1));
+    bool pooled = file.get_buffer_pool().get_hits() == 2 && file.get_buffer_pool().get_misses() == 0;
+    file.drop();
+    if (!pooled)
+    {
+        std::cout << "Wrong buffer pool hit/miss counts" << std::endl;
+        return false;
+    }
+
+    // 16kB pages hold four times the rows, and reopening the file finds its page size on its own
+    // (and leaves out the blocks of the extent that were never handed out); the saved metadata has the row count
+    HeapTable wide("_test_wide_cpp", column_names, column_attributes, new HeapFile("_test_wide_cpp", 16384));
+    wide.create();
+    Handle wide_handle;
+    for (int i = 0; i < 500; i++)
+        wide_handle = wide.insert(&row);
+    wide.close();
+    HeapFile reopened("_test_wide_cpp");
+    reopened.open();
+    bool sized = wide_handle.first == 1 && reopened.get_block_size() == 16384 && reopened.get_last_block_id() == 1 &&
+                 reopened.get_row_count() == 500;
+    reopened.close();
+    wide.drop();
+    // a page size the _tables schema would refuse is refused here too
+    try
+    {
+        HeapFile odd("_test_odd_cpp", 3 * DbBlock::BLOCK_SZ);
+        sized = false;
+    }
+    catch (DbRelationError &e)
+    {
+    }
+    if (!sized)
+    {
+        std::cout << "Wrong page size" << std::endl;
+        return false;
+    }
     return true;
 }
 
@@ -766,12 +2684,12 @@ bool test_slotted_page()
         return false;
     }
 
-    // Add record3 "George"
+    // Add record3 "George" (takes over the slot record1 left free)
     Dbt rec3_dbt = Dbt(record3, sizeof(record3));
     id = slot.add(&rec3_dbt);
-    if (id != 3)
+    if (id != 1)
     {
-        std::cout << "Wrong Add record1 id" << std::endl;
+        std::cout << "Wrong Add record3 id" << std::endl;
         return false;
     }
 
@@ -785,5 +2703,119 @@ bool test_slotted_page()
     //     return false;
     // }
     delete ids;
+
+    // fill a page, punch holes in it, then add something that only fits once the holes are squeezed out
+    char full_block[DbBlock::BLOCK_SZ];
+    Dbt full_data(full_block, sizeof(full_block));
+    SlottedPage full(full_data, 2, true);
+    char small[] = "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz";
+    Dbt small_dbt(small, sizeof(small));
+    RecordID n = 0;
+    try
+    {
+        while (true)
+            n = full.add(&small_dbt);
+    }
+    catch (DbBlockNoRoomError &e)
+    {
+    }
+    for (RecordID record_id = 1; record_id <= n; record_id += 2)
+        full.del(record_id);
+    char big[512];
+    memset(big, 'x', sizeof(big));
+    Dbt big_dbt(big, sizeof(big));
+    RecordID big_id = full.add(&big_dbt);
+    for (RecordID record_id = 2; record_id <= n; record_id += 2)
+    {
+        RecordView record;
+        if (!full.view(record_id, record) || record.size != sizeof(small) || memcmp(record.data, small, sizeof(small)) != 0)
+        {
+            std::cout << "Wrong record after compaction" << std::endl;
+            return false;
+        }
+    }
+    RecordView big_record;
+    if (!full.view(big_id, big_record) || big_record.size != sizeof(big) || memcmp(big_record.data, big, sizeof(big)) != 0)
+    {
+        std::cout << "Wrong record added by compaction" << std::endl;
+        return false;
+    }
+
+    // churn: deleting and adding over and over should keep reusing the same slots
+    for (int i = 0; i < 1000; i++)
+    {
+        full.del(big_id);
+        big_id = full.add(&big_dbt);
+    }
+    ids = full.ids();
+    bool dense = big_id == 1 && ids->size() == (size_t)(n / 2 + 1) && ids->back() == n - n % 2;
+    delete ids;
+    if (!dense)
+    {
+        std::cout << "Wrong slot reuse" << std::endl;
+        return false;
+    }
+
+    // a forwarded record keeps its id as a stub; a moved-in record is only found through its stub
+    Handle target;
+    RecordView stub_view;
+    full.forward(big_id, Handle(7, 3));
+    bool forwarding = full.forwarded(big_id, target) && target == Handle(7, 3) && !full.view(big_id, stub_view);
+    RecordID moved_id = full.add_moved(&small_dbt);
+    ids = full.ids();
+    forwarding = forwarding && std::find(ids->begin(), ids->end(), big_id) != ids->end() &&
+                 std::find(ids->begin(), ids->end(), moved_id) == ids->end();
+    delete ids;
+    Dbt grown_dbt(big, 300);
+    full.put(moved_id, grown_dbt); // too big for what's left at the end, so the block compacts around the stub
+    forwarding = forwarding && full.view(moved_id, stub_view) && stub_view.size == 300 &&
+                 full.forwarded(big_id, target) && target == Handle(7, 3) && !full.forwarded(moved_id, target);
+    RecordID record_id = 0;
+    while (full.next_id(record_id))
+        forwarding = forwarding && record_id != moved_id;
+    if (!forwarding)
+    {
+        std::cout << "Wrong forwarding" << std::endl;
+        return false;
+    }
+
+    // records smaller than a stub still have room to be forwarded in place, even on a full page
+    char tiny_block[DbBlock::BLOCK_SZ];
+    Dbt tiny_data(tiny_block, sizeof(tiny_block));
+    SlottedPage tiny(tiny_data, 3, true);
+    char two[] = "t";
+    Dbt two_dbt(two, sizeof(two));
+    n = 0;
+    try
+    {
+        while (true)
+            n = tiny.add(&two_dbt);
+    }
+    catch (DbBlockNoRoomError &e)
+    {
+    }
+    bool stubbed = tiny.get_free_space() == 0;
+    try
+    {
+        tiny.forward(n / 2, Handle(9, 4));
+        tiny.forward(n, Handle(9, 5));
+    }
+    catch (DbBlockNoRoomError &e)
+    {
+        stubbed = false;
+    }
+    stubbed = stubbed && tiny.forwarded(n / 2, target) && target == Handle(9, 4) &&
+              tiny.forwarded(n, target) && target == Handle(9, 5);
+    for (record_id = 1; stubbed && record_id < n; record_id++)
+    {
+        RecordView record;
+        if (record_id != n / 2)
+            stubbed = tiny.view(record_id, record) && record.size == sizeof(two) && memcmp(record.data, two, sizeof(two)) == 0;
+    }
+    if (!stubbed)
+    {
+        std::cout << "Wrong forwarding of small records" << std::endl;
+        return false;
+    }
     return true;
 }
@@ -9,7 +9,12 @@
  */
 #pragma once
 
+#include <functional>
+#include <mutex>
 #include "db_cxx.h"
+#include "buffer_pool.h"
+#include "free_space_map.h"
+#include "int_filter.h"
 #include "storage_engine.h"
 
 /**
@@ -18,18 +23,33 @@
  *      Manage a database block that contains several records.
         Modeled after slotted-page from Database Systems Concepts, 6ed, Figure 10-9.
 
-        Record id are handed out sequentially starting with 1 as records are added with add().
+        Record ids start at 1. add() reuses the slot of a deleted record when there is one (the
+        lowest, found through a hint in the block header) and only otherwise hands out the next id.
+        The block may be any size up to DbBlock::MAX_BLOCK_SZ, so 2-byte offsets always reach its end.
         Each record has a header which is a fixed offset from the beginning of the block:
             Bytes 0x00 - Ox01: number of records
             Bytes 0x02 - 0x03: offset to end of free space
-            Bytes 0x04 - 0x05: size of record 1
-            Bytes 0x06 - 0x07: offset to record 1
+            Bytes 0x04 - 0x05: number of fragmented bytes (left behind by del() and put())
+            Bytes 0x06 - 0x07: first free record id (0 if every slot is in use)
+            Bytes 0x08 - 0x09: size of record 1
+            Bytes 0x0A - 0x0B: offset to record 1
             etc.
+        Deleting the highest record id shrinks the slot directory instead of leaving a free slot.
+        Deleting or shrinking a record only leaves a hole. The holes are squeezed out all at once
+        by compact(), and only when add() or put() needs more contiguous room than there is.
+        A record that had to move to another block leaves a stub behind: a header with size 0
+        pointing at the record's new BlockID and RecordID. In its new block the record's size has
+        the MOVED bit set, which keeps records to MAX_RECORD_SZ bytes.
  *
  */
 class SlottedPage : public DbBlock
 {
 public:
+    /**
+     * largest record (the top bit of the size in a record's header is the MOVED flag)
+     */
+    static const u_int16_t MAX_RECORD_SZ = 0x7fff;
+
     SlottedPage(Dbt &block, BlockID block_id, bool is_new = false);
 
     // Big 5 - we only need the destructor, copy-ctor, move-ctor, and op= are unnecessary
@@ -48,23 +68,52 @@ public:
 
     virtual Dbt *get(RecordID record_id);
 
+    virtual bool view(RecordID record_id, RecordView &record);
+
     virtual void put(RecordID record_id, const Dbt &data);
 
     virtual void del(RecordID record_id);
 
     virtual RecordIDs *ids(void);
 
+    virtual bool next_id(RecordID &record_id);
+
+    virtual void forward(RecordID record_id, Handle target);
+
+    virtual bool forwarded(RecordID record_id, Handle &target);
+
+    virtual RecordID add_moved(const Dbt *data);
+
+    virtual bool next_moved(RecordID &record_id);
+
+    virtual bool is_empty() { return num_records == 0; }
+
+    virtual u_int32_t get_free_space();
+
 protected:
+    static const u_int16_t MOVED = 0x8000;                          // size bit of a record whose stub is in another block
+    static const u_int16_t STUB_SZ = sizeof(BlockID) + sizeof(RecordID); // bytes a stub points at
+
     u_int16_t num_records;
     u_int16_t end_free;
+    u_int16_t fragmented;
+    u_int16_t free_slot;
 
     virtual void get_header(u_int16_t &size, u_int16_t &loc, RecordID id = 0);
 
     virtual void put_header(RecordID id = 0, u_int16_t size = 0, u_int16_t loc = 0);
 
+    virtual u_int16_t stored_size(u_int16_t size, u_int16_t loc);
+
     virtual bool has_room(u_int16_t size);
 
-    virtual void slide(u_int16_t start, u_int16_t end);
+    virtual u_int16_t contiguous_room();
+
+    virtual void release(u_int16_t size, u_int16_t loc);
+
+    virtual void compact();
+
+    virtual u_int16_t next_free_slot(u_int16_t after);
 
     virtual u_int16_t get_n(u_int16_t offset);
 
@@ -77,16 +126,36 @@ protected:
  * @class HeapFile - heap file implementation of DbFile
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one of our
-        database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
-        for buffer management and file management.
-        Uses SlottedPage for storing records within blocks.
+        database blocks for each Berkeley DB record in the RecNo file. Berkeley DB does the
+        file management; blocks are cached in our own BufferPool so that a block fetched
+        repeatedly is only read (and wrapped in a SlottedPage) once.
+        A FreeSpaceMap remembers roughly how much room each block has so that space
+        freed in earlier blocks can be reused.
+        The block size is chosen when the file is created and kept by Berkeley DB as the RecNo
+        record length, so opening an existing file always uses the size it was created with.
+        Uses SlottedPage for storing records within blocks (subclasses may choose another
+        DbBlock through new_block()).
+        The file grows EXTENT_BLOCKS blocks at a time. The extra blocks are left zeroed until
+        get_new() hands them out, which just formats the page in the buffer pool; it reaches the
+        file when the pool writes it back. Zeroed blocks at the end are not counted when the file
+        is opened again.
+        The block size and counts are saved with the free-space map on close or flush() (see HeapFileMeta), so
+        open() reads one record and leaves opening the Berkeley DB file itself until the first
+        block is read or written. Files without that record are measured with Db::stat instead.
+        The map also knows which blocks are empty, so block_ids() leaves them out and scans
+        can ask is_empty() before reading one. truncate() gives back the blocks at the end.
  */
 class HeapFile : public DbFile
 {
 public:
-    HeapFile(std::string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {}
+    /**
+     * blocks added to the file at a time
+     */
+    static const uint EXTENT_BLOCKS = 8;
+
+    HeapFile(std::string name, uint block_sz = DbBlock::BLOCK_SZ);
 
-    virtual ~HeapFile() {}
+    virtual ~HeapFile();
 
     HeapFile(const HeapFile &other) = delete;
 
@@ -104,35 +173,179 @@ public:
 
     virtual void close(void);
 
-    virtual SlottedPage *get_new(void);
+    /**
+     * Write back the dirty blocks and the metadata, leaving the file open.
+     */
+    virtual void flush(void);
 
-    virtual SlottedPage *get(BlockID block_id);
+    virtual DbBlock *get_new(void);
+
+    virtual DbBlock *get(BlockID block_id);
 
     virtual void put(DbBlock *block);
 
+    virtual void release(DbBlock *block);
+
     virtual BlockIDs *block_ids();
 
+    virtual bool next_block_id(BlockID &block_id);
+
+    /**
+     * Get an existing block formatted empty, as get_new() would, without reading it first.
+     * @param block_id  which block (its records are thrown away)
+     * @returns         the empty block (pinned, hand back with release())
+     */
+    virtual DbBlock *get_blank(BlockID block_id);
+
+    /**
+     * Cut the file short after block last: the blocks after it are forgotten, unwritten, and
+     * their records taken out of the Berkeley DB file. They must not be pinned.
+     * @param last  last block id to keep
+     */
+    virtual void truncate(BlockID last);
+
+    /**
+     * Whether the free-space map knows the block holds nothing (false if it doesn't know).
+     */
+    virtual bool is_empty(BlockID block_id) const { return fsm.is_empty(block_id); }
+
     virtual u_int32_t get_last_block_id() { return last; }
 
+    /**
+     * Number of records in the file, as kept up to date by the table using it.
+     */
+    virtual u_int64_t get_row_count() const { return row_count; }
+
+    virtual void rows_changed(int64_t change)
+    {
+        row_count += change;
+        fsm.touch();
+    }
+
+    virtual uint get_block_size() const { return block_sz; }
+
+    virtual BlockID find_room(u_int32_t size) { return fsm.find(size); }
+
+    virtual const BufferPool &get_buffer_pool() const { return pool; }
+
 protected:
     std::string dbfilename;
-    u_int32_t last;
+    u_int32_t last;      // blocks handed out by get_new()
+    u_int32_t allocated; // blocks in the file, including zeroed ones not handed out yet
+    uint block_sz;
+    u_int64_t row_count;
     bool closed;
+    bool lazy; // open, but the Berkeley DB file is not opened yet
     Db db;
+    BufferPool pool;
+    FreeSpaceMap fsm;
 
     virtual void db_open(uint flags = 0);
+
+    virtual void db_handle();
+
+    virtual void measure();
+
+    virtual u_int64_t count_rows();
+
+    virtual void save_meta();
+
+    virtual void extend();
+
+    static bool is_blank(const void *data, uint size);
+
+    virtual DbBlock *new_block(Dbt &data, BlockID block_id, bool is_new);
+};
+
+/**
+ * @class RowLayout - where each column's field sits in a row marshaled by HeapTable
+ *
+ *      Fields follow each other in column order: INT is 4 bytes, BOOLEAN 1 byte, and TEXT a 2-byte
+        length followed by the characters. If any column is TEXT, the row starts with an offset table,
+        one 2-byte offset (from the start of the row) per column, so any field can be found without
+        decoding the ones in front of it. Otherwise every row has the same offsets and they are kept here.
+ */
+class RowLayout
+{
+public:
+    RowLayout(const ColumnAttributes &column_attributes);
+
+    /**
+     * Bytes at the front of each row before the first field (the offset table, if there is one).
+     */
+    u_int16_t header_size() const { return variable ? 2 * data_types.size() : 0; }
+
+    /**
+     * Where a column's field starts within a marshaled row.
+     */
+    u_int16_t field_offset(const char *row, uint col_num) const
+    {
+        return variable ? ((const u_int16_t *)row)[col_num] : fixed_offsets[col_num];
+    }
+
+    const std::vector<ColumnAttribute::DataType> &get_data_types() const { return data_types; }
+
+    bool is_variable() const { return variable; }
+
+protected:
+    std::vector<ColumnAttribute::DataType> data_types;
+    std::vector<u_int16_t> fixed_offsets;
+    bool variable;
 };
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * select(where, parallelism) splits the blocks into morsels of MORSEL_BLOCKS and has the threads of
+ * the shared WorkerPool take them one at a time. The file and its buffer pool are not safe to use
+ * from two threads, so fetching and releasing a block is done under a lock; checking the records
+ * of a pinned block against the where-clause is not.
+ *
+ * scan(where, column_names) decodes the rows that pass while each block is still pinned, so a
+ * query reads its blocks once and keeps no handles.
+ *
+ * update() rewrites a record in place when it fits. One that has outgrown its block moves to
+ * another and leaves a stub in its slot (see SlottedPage), so handles never change; reading a row
+ * through its handle follows the stub with locate().
+ *
+ * Scans pull one INT column of the where-clause out of each page into an array and check the
+ * whole page at once with filter_ints(); the rest of the where-clause is then checked only for
+ * the records that passed.
+ *
+ * Scans pass by the blocks the file knows are empty without reading them. vacuum() goes further
+ * and packs the rows into the blocks at the front of the file, bringing moved rows home, then
+ * truncates the file after the last block it used.
  */
 
 class HeapTable : public DbRelation
 {
-public:
-    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+    friend class HeapTableCursor;
 
-    virtual ~HeapTable() {}
+public:
+    /**
+     * where-clause lined up with the columns: the value each column must equal, or nullptr
+     */
+    typedef std::vector<const Value *> Predicates;
+
+    /**
+     * where-clause split for a scan: an INT column checked a page at a time, the rest record by record
+     */
+    struct BlockFilter
+    {
+        int col_num = -1; // column run through filter_ints(), or -1 for none
+        IntComparison comparison;
+        Predicates predicates;
+    };
+
+    /**
+     * blocks in each piece (morsel) of a parallel scan
+     */
+    static const uint MORSEL_BLOCKS = 16;
+
+    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+              HeapFile *file = nullptr);
+
+    virtual ~HeapTable();
 
     HeapTable(const HeapTable &other) = delete;
 
@@ -152,8 +365,14 @@ public:
 
     virtual void close();
 
+    virtual void flush();
+
     virtual Handle insert(const ValueDict *row);
 
+    virtual Handles *insert_batch(const ValueDicts &rows);
+
+    virtual Handle insert(const Row &row);
+
     virtual void update(const Handle handle, const ValueDict *new_values);
 
     virtual void del(const Handle handle);
@@ -162,20 +381,136 @@ public:
 
     virtual Handles *select(const ValueDict *where);
 
+    virtual Handles *select(const ValueDict *where, uint parallelism);
+
+    /**
+     * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <column_name> <comparison> AND <where>
+     * @param column_name  an INT column
+     * @param comparison   =, <, > or BETWEEN against constants
+     * @param where        other where-clause predicates (nullptr for none)
+     * @param parallelism  as for select(where, parallelism)
+     * @returns            a pointer to a list of handles for qualifying rows (freed by caller)
+     */
+    virtual Handles *select(const Identifier &column_name, const IntComparison &comparison,
+                            const ValueDict *where = nullptr, uint parallelism = 1);
+
+    virtual DbRelationCursor *cursor(const ValueDict *where = nullptr);
+
+    virtual ValueDicts *scan(const ValueDict *where = nullptr, const ColumnNames *column_names = nullptr,
+                             uint parallelism = 1);
+
     virtual ValueDict *project(Handle handle);
 
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
 
+    virtual void project(Handle handle, Row &row);
+
+    virtual ValueDicts *project_many(const Handles &handles, const ColumnNames *column_names = nullptr);
+
+    virtual Relocations *vacuum();
+
+    using DbRelation::project;
+
 protected:
-    HeapFile file;
+    HeapFile *file;
+    RowLayout layout;
+    std::mutex file_lock; // held for each use of the file during a parallel scan
+
+    virtual void validate(const ValueDict *row, Row &full_row);
 
-    virtual ValueDict *validate(const ValueDict *row);
+    virtual Handle append(const Row &row);
 
-    virtual Handle append(const ValueDict *row);
+    virtual void relocate(DbBlock *block, RecordID record_id, const Dbt &data);
+
+    virtual DbBlock *room_for(u_int32_t size);
 
     virtual Dbt *marshal(const ValueDict *row);
 
+    virtual u_int32_t marshal(const ValueDict *row, char *bytes);
+
+    virtual u_int32_t marshal(const Row &row, char *bytes);
+
     virtual ValueDict *unmarshal(Dbt *data);
+
+    virtual ValueDict *unmarshal(const RecordView &record);
+
+    virtual ValueDict *unmarshal(const RecordView &record, const ColumnNames *column_names);
+
+    virtual Value unmarshal(const RecordView &record, uint col_num);
+
+    virtual void unmarshal(const RecordView &record, Row &row);
+
+    virtual uint column_number(const Identifier &column_name);
+
+    virtual void compile(const ValueDict *where, Predicates &predicates);
+
+    virtual bool selected(const RecordView &record, const Predicates &predicates);
+
+    virtual bool selected(DbBlock *block, RecordID record_id, const Predicates &predicates);
+
+    virtual bool locate(DbBlock *block, RecordID record_id, RecordView &record, DbBlock *&moved);
+
+    virtual DbBlock *pin(BlockID block_id);
+
+    virtual void unpin(DbBlock *block);
+
+    virtual void compile(const ValueDict *where, BlockFilter &filter);
+
+    /**
+     * what for_each_block() does with each pinned block, and which morsel the block is in
+     */
+    typedef std::function<void(DbBlock *block, BlockID block_id, uint morsel)> BlockVisitor;
+
+    virtual void for_each_block(BlockID last, uint parallelism, const BlockVisitor &visit);
+
+    virtual Handles *filter_blocks(const BlockFilter &filter, uint parallelism);
+
+    virtual void filter_block(DbBlock *block, BlockID block_id, const BlockFilter &filter, Handles &handles);
+
+    virtual void gather(DbBlock *block, uint col_num, std::vector<RecordID> &record_ids, std::vector<int32_t> &values);
+};
+
+/**
+ * @class HeapTableCursor - scan of a HeapTable (implementation of DbRelationCursor)
+ *
+ * Keeps the current block pinned while its records are handed out, then moves on
+ * to the next block. Nothing is materialized, so memory use does not grow with the table.
+ * The file is told about the next READ_AHEAD blocks before the scan gets to them (only an
+ * MmapPageFile acts on that; a Berkeley DB file's blocks aren't at offsets we could name).
+ */
+class HeapTableCursor : public DbRelationCursor
+{
+public:
+    /**
+     * blocks the file is asked to read ahead of the one being scanned
+     */
+    static const uint READ_AHEAD = 16;
+
+    HeapTableCursor(HeapTable &table, const ValueDict *where = nullptr);
+
+    virtual ~HeapTableCursor();
+
+    HeapTableCursor(const HeapTableCursor &other) = delete;
+
+    HeapTableCursor(HeapTableCursor &&temp) = delete;
+
+    HeapTableCursor &operator=(const HeapTableCursor &other) = delete;
+
+    HeapTableCursor &operator=(HeapTableCursor &&temp) = delete;
+
+    virtual bool next(Handle &handle);
+
+    virtual ValueDict *project(const ColumnNames *column_names = nullptr);
+
+    virtual void project(Row &row);
+
+protected:
+    HeapTable &table;
+    HeapTable::Predicates predicates;
+    DbBlock *block;
+    BlockID block_id;
+    RecordID record_id;
+    BlockID prefetched; // last block the file has been told we'll want
 };
 
 bool test_heap_storage();
@@ -0,0 +1,117 @@
+/**
+ * @file int_filter.cpp - Implementation of IntComparison and filter_ints.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "int_filter.h"
+#include <climits>
+#include <cstring>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define INT_FILTER_X86 1
+#endif
+
+bool IntComparison::matches(int32_t n) const
+{
+    switch (this->op)
+    {
+    case EQ:
+        return n == this->low;
+    case LT:
+        return n < this->low;
+    case GT:
+        return n > this->low;
+    default:
+        return this->low <= n && n <= this->high;
+    }
+}
+
+// Every comparison we know is a range, so the kernels only have to do one thing.
+bool IntComparison::range(int32_t &low, int32_t &high) const
+{
+    switch (this->op)
+    {
+    case EQ:
+        low = high = this->low;
+        return true;
+    case LT:
+        low = INT32_MIN;
+        high = this->low - 1;
+        return this->low != INT32_MIN;
+    case GT:
+        low = this->low + 1;
+        high = INT32_MAX;
+        return this->low != INT32_MAX;
+    default:
+        low = this->low;
+        high = this->high;
+        return low <= high;
+    }
+}
+
+// Set the bits for values[start..count), one at a time.
+static void filter_scalar(const int32_t *values, uint start, uint count, int32_t low, int32_t high,
+                          u_int64_t *selection)
+{
+    for (uint i = start; i < count; i++)
+        if (low <= values[i] && values[i] <= high)
+            selection[i / 64] |= (u_int64_t)1 << (i % 64);
+}
+
+#ifdef INT_FILTER_X86
+// Eight values per compare. Returns how many were done; the caller finishes the rest.
+__attribute__((target("avx2"))) static uint filter_avx2(const int32_t *values, uint count, int32_t low,
+                                                        int32_t high, u_int64_t *selection)
+{
+    __m256i lows = _mm256_set1_epi32(low);
+    __m256i highs = _mm256_set1_epi32(high);
+    uint i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(values + i));
+        __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lows, x), _mm256_cmpgt_epi32(x, highs));
+        u_int64_t bits = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xff;
+        selection[i / 64] |= bits << (i % 64);
+    }
+    return i;
+}
+
+// Four values per compare; every x86-64 CPU can do this.
+static uint filter_sse2(const int32_t *values, uint count, int32_t low, int32_t high, u_int64_t *selection)
+{
+    __m128i lows = _mm_set1_epi32(low);
+    __m128i highs = _mm_set1_epi32(high);
+    uint i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128i out = _mm_or_si128(_mm_cmplt_epi32(x, lows), _mm_cmpgt_epi32(x, highs));
+        u_int64_t bits = ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xf;
+        selection[i / 64] |= bits << (i % 64);
+    }
+    return i;
+}
+
+// Asked once; the answer doesn't change while we run.
+static bool has_avx2()
+{
+    static bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return avx2;
+}
+#endif
+
+// Clear the bitmap, then let the widest kernel the CPU has do all it can and finish the tail one by one.
+void filter_ints(const int32_t *values, uint count, const IntComparison &comparison, u_int64_t *selection)
+{
+    memset(selection, 0, (count + 63) / 64 * sizeof(u_int64_t));
+    int32_t low, high;
+    if (!comparison.range(low, high))
+        return;
+    uint done = 0;
+#ifdef INT_FILTER_X86
+    done = has_avx2() ? filter_avx2(values, count, low, high, selection)
+                      : filter_sse2(values, count, low, high, selection);
+#endif
+    filter_scalar(values, done, count, low, high, selection);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file int_filter.h - Comparing a run of INT values against a constant all at once.
+ * IntComparison
+ * filter_ints
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+
+/**
+ * @class IntComparison - a simple comparison of an INT column against constants: =, <, > or BETWEEN
+ */
+class IntComparison
+{
+public:
+    enum Op
+    {
+        EQ,
+        LT,
+        GT,
+        BETWEEN
+    };
+
+    IntComparison(Op op = EQ, int32_t low = 0, int32_t high = 0) : op(op), low(low), high(high) {}
+
+    static IntComparison between(int32_t low, int32_t high) { return IntComparison(BETWEEN, low, high); }
+
+    /**
+     * Whether n passes, one value at a time.
+     */
+    bool matches(int32_t n) const;
+
+    /**
+     * The same comparison as an inclusive range [low, high].
+     * @returns  false if nothing can pass
+     */
+    bool range(int32_t &low, int32_t &high) const;
+
+    Op op;
+    int32_t low;  // the constant for =, < and >
+    int32_t high; // only for BETWEEN (inclusive, like SQL)
+};
+
+/**
+ * Compare count values against comparison and set bit i (of word i / 64) of selection for each
+ * one that passes. Uses AVX2 when the CPU has it, SSE2 otherwise on x86-64, and a plain loop elsewhere.
+ * @param values      the values, one after the other
+ * @param count       how many
+ * @param comparison  what each value is checked against
+ * @param selection   room for (count + 63) / 64 words, all overwritten
+ */
+void filter_ints(const int32_t *values, uint count, const IntComparison &comparison, u_int64_t *selection);
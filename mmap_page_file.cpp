@@ -0,0 +1,232 @@
+/**
+ * @file mmap_page_file.cpp - Implementation of MmapPageFile.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "mmap_page_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Where the page file for name lives: the database environment's home directory.
+static std::string page_file_path(const std::string &name)
+{
+    const char *home = nullptr;
+    _DB_ENV->get_home(&home);
+    return std::string(home != nullptr ? home : ".") + "/" + name + ".pages";
+}
+
+// The path is known up front, so drop() works on a file that was never opened.
+MmapPageFile::MmapPageFile(std::string name, uint block_sz) : HeapFile(name, block_sz), path(page_file_path(name)),
+                                                              fd(-1) {}
+
+MmapPageFile::~MmapPageFile()
+{
+    close();
+}
+
+// Create the page file with its first block.
+void MmapPageFile::create(void)
+{
+    file_open(O_RDWR | O_CREAT | O_EXCL);
+    this->row_count = 0;
+    this->fsm.create();
+    DbBlock *block = get_new(); // first block of the file
+    release(block);
+}
+
+// Delete the page file (and its free-space map).
+void MmapPageFile::drop(void)
+{
+    close();
+    this->fsm.drop();
+    unlink(this->path.c_str());
+}
+
+// Open the page file; the number of blocks comes from its size, the number of rows from the saved metadata.
+void MmapPageFile::open(void)
+{
+    if (!this->closed)
+        return;
+    file_open(O_RDWR);
+    HeapFileMeta meta;
+    bool saved = false;
+    try
+    {
+        saved = this->fsm.open(meta);
+    }
+    catch (DbException &e)
+    {
+        this->fsm.create(); // made before we kept a map
+    }
+    this->fsm.cover(this->last);
+    this->row_count = saved ? meta.row_count : count_rows();
+}
+
+// Unmap everything and close the page file.
+void MmapPageFile::close(void)
+{
+    if (this->closed)
+        return;
+    for (auto page : this->pages)
+        delete page;
+    this->pages.clear();
+    for (auto segment : this->segments)
+        munmap(segment, SEGMENT_BLOCKS * this->block_sz);
+    this->segments.clear();
+    save_meta();
+    this->fsm.close();
+    ::close(this->fd);
+    this->fd = -1;
+    this->closed = true;
+}
+
+// Hand back an initialized page over the next block, growing the file by an extent when it runs out.
+DbBlock *MmapPageFile::get_new(void)
+{
+    BlockID block_id = this->last + 1;
+    if (block_id > this->allocated)
+        extend();
+    this->last = block_id;
+    Dbt data(address(block_id), this->block_sz);
+    DbBlock *page = new_block(data, block_id, true);
+    delete this->pages[block_id - 1];
+    this->pages[block_id - 1] = page;
+    this->fsm.set(block_id, page->get_free_space(), true);
+    return page;
+}
+
+// Format a block we already have in place, like get_new() does.
+DbBlock *MmapPageFile::get_blank(BlockID block_id)
+{
+    if (block_id == 0 || block_id > this->last)
+        throw DbRelationError("block " + std::to_string(block_id) + " not found");
+    Dbt data(address(block_id), this->block_sz);
+    DbBlock *page = new_block(data, block_id, true);
+    delete this->pages[block_id - 1];
+    this->pages[block_id - 1] = page;
+    this->fsm.set(block_id, page->get_free_space(), true);
+    return page;
+}
+
+// Cut the file right after block last. The segments stay mapped; nothing touches the pages past
+// the end of the file, and they read as zeros again once extend() grows it back over them.
+void MmapPageFile::truncate(BlockID last)
+{
+    if (last >= this->last)
+        return;
+    for (BlockID block_id = last + 1; block_id <= this->pages.size(); block_id++)
+    {
+        delete this->pages[block_id - 1];
+        this->pages[block_id - 1] = nullptr;
+    }
+    if (ftruncate(this->fd, HEADER_SZ + (off_t)last * this->block_sz) != 0)
+        throw DbRelationError("cannot truncate " + this->path);
+    this->last = this->allocated = last;
+    this->fsm.cover(last);
+    save_meta();
+}
+
+// Get a block. The page object is made the first time and reused after that.
+DbBlock *MmapPageFile::get(BlockID block_id)
+{
+    if (block_id == 0 || block_id > this->last)
+        throw DbRelationError("block " + std::to_string(block_id) + " not found");
+    DbBlock *&page = this->pages[block_id - 1];
+    if (page == nullptr)
+    {
+        Dbt data(address(block_id), this->block_sz);
+        page = new_block(data, block_id, false);
+    }
+    return page;
+}
+
+// Blocks past the end of the file read as zeros, so one ftruncate() preallocates a whole extent.
+void MmapPageFile::extend()
+{
+    BlockID allocated = this->allocated + EXTENT_BLOCKS;
+    if (ftruncate(this->fd, HEADER_SZ + (off_t)allocated * this->block_sz) != 0)
+        throw DbRelationError("cannot extend " + this->path);
+    this->allocated = allocated;
+}
+
+// The blocks are right where the mapping says, so the kernel can be asked for exactly those pages.
+void MmapPageFile::prefetch(BlockID block_id, uint count)
+{
+    if (block_id == 0 || block_id > this->last)
+        return;
+    BlockID end = std::min(block_id + count - 1, this->last);
+    while (block_id <= end)
+    {
+        // one segment at a time, since the segments need not be next to each other in memory
+        BlockID segment_end = std::min(end, ((block_id - 1) / SEGMENT_BLOCKS + 1) * SEGMENT_BLOCKS);
+        madvise(address(block_id), (size_t)(segment_end - block_id + 1) * this->block_sz, MADV_WILLNEED);
+        block_id = segment_end + 1;
+    }
+}
+
+// The page was changed in place in the shared mapping, so there is nothing to write.
+void MmapPageFile::put(DbBlock *block)
+{
+}
+
+// Open (or create) the page file in the database environment's home directory.
+// A new file gets its header written; an existing one supplies the block size from its header.
+// Failing to open throws a DbException, just like a missing HeapFile, so create_if_not_exists() works.
+void MmapPageFile::file_open(int flags)
+{
+    if (!this->closed)
+        return;
+    this->fd = ::open(this->path.c_str(), flags, 0644);
+    if (this->fd < 0)
+        throw DbException(("cannot open " + this->path).c_str(), errno);
+    u_int32_t header[2];
+    if (flags & O_CREAT)
+    {
+        header[0] = MAGIC;
+        header[1] = this->block_sz;
+        if (ftruncate(this->fd, HEADER_SZ) != 0 || pwrite(this->fd, header, sizeof(header), 0) != sizeof(header))
+        {
+            ::close(this->fd);
+            throw DbRelationError("cannot write header of " + this->path);
+        }
+    }
+    else if (pread(this->fd, header, sizeof(header), 0) != sizeof(header) || header[0] != MAGIC)
+    {
+        ::close(this->fd);
+        throw DbRelationError(this->path + " is not a page file");
+    }
+    this->block_sz = header[1];
+    this->fsm.set_block_size(this->block_sz);
+    struct stat st;
+    fstat(this->fd, &st);
+    this->allocated = (st.st_size - HEADER_SZ) / this->block_sz;
+    this->closed = false;
+
+    // the rest of the last extent was never handed out
+    this->last = this->allocated;
+    while (this->last > 0 && is_blank(address(this->last), this->block_sz))
+        this->last--;
+}
+
+// Address of a block in the mapping, mapping more segments if the block is past the ones we have.
+char *MmapPageFile::address(BlockID block_id)
+{
+    uint segment = (block_id - 1) / SEGMENT_BLOCKS;
+    while (this->segments.size() <= segment)
+    {
+        off_t offset = HEADER_SZ + (off_t)this->segments.size() * SEGMENT_BLOCKS * this->block_sz;
+        void *mapped = mmap(nullptr, SEGMENT_BLOCKS * this->block_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            this->fd, offset);
+        if (mapped == MAP_FAILED)
+            throw DbRelationError("cannot map " + this->path);
+        this->segments.push_back((char *)mapped);
+    }
+    if (this->pages.size() < block_id)
+        this->pages.resize(this->segments.size() * SEGMENT_BLOCKS, nullptr);
+    return this->segments[segment] + ((block_id - 1) % SEGMENT_BLOCKS) * this->block_sz;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file mmap_page_file.h - HeapFile kept in a flat file of pages and accessed through mmap.
+ * MmapPageFile: HeapFile
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <vector>
+#include "heap_storage.h"
+
+/**
+ * @class MmapPageFile - native page file implementation of DbFile
+ *
+ *      The file <dbenv home>/<name>.pages starts with a HEADER_SZ header holding a magic number
+        and the block size, and block i lives at byte offset HEADER_SZ + (i-1)*block_sz. The file is
+        mapped shared into memory in segments of SEGMENT_BLOCKS blocks, and each SlottedPage works
+        directly on the mapped bytes, so there is no Berkeley DB call and no copy on any block access.
+        Segments are never moved once mapped, so pinned pages stay valid while the file grows.
+        Changes reach the file through the page cache; put() has nothing left to do.
+        Free space is still tracked by the HeapFile's FreeSpaceMap, and the file grows an extent at a
+        time just like a HeapFile.
+        Since block i is at a known offset, prefetch() can have the kernel read ahead exactly the
+        blocks a scan is coming to, which a Berkeley DB file can't.
+ */
+class MmapPageFile : public HeapFile
+{
+public:
+    /**
+     * blocks per mapped segment
+     */
+    static const uint SEGMENT_BLOCKS = 256;
+
+    /**
+     * bytes before the first block (kept a multiple of the OS page size so segments map aligned)
+     */
+    static const uint HEADER_SZ = DbBlock::BLOCK_SZ;
+
+    /**
+     * first word of the header
+     */
+    static const u_int32_t MAGIC = 0x50414745; // "PAGE"
+
+    MmapPageFile(std::string name, uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~MmapPageFile();
+
+    MmapPageFile(const MmapPageFile &other) = delete;
+
+    MmapPageFile(MmapPageFile &&temp) = delete;
+
+    MmapPageFile &operator=(const MmapPageFile &other) = delete;
+
+    MmapPageFile &operator=(MmapPageFile &&temp) = delete;
+
+    virtual void create(void);
+
+    virtual void drop(void);
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual DbBlock *get_new(void);
+
+    virtual DbBlock *get(BlockID block_id);
+
+    virtual void put(DbBlock *block);
+
+    virtual void prefetch(BlockID block_id, uint count);
+
+    virtual DbBlock *get_blank(BlockID block_id);
+
+    virtual void truncate(BlockID last);
+
+protected:
+    std::string path;
+    int fd;
+    std::vector<char *> segments;
+    std::vector<DbBlock *> pages; // page objects for blocks we have touched, by block id - 1
+
+    virtual void file_open(int flags);
+
+    virtual void extend();
+
+    virtual char *address(BlockID block_id);
+};
@@ -0,0 +1,498 @@
+/**
+ * @file pax_storage.cpp - Implementation of PaxPage, PaxHeapFile and PaxTable.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "pax_storage.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <tuple>
+
+typedef u_int16_t u16;
+
+static const u16 PAX_HEADER_SZ = 10;
+
+// Bytes one record takes in a column's minipage.
+static uint minipage_width(ColumnAttribute::DataType data_type)
+{
+    switch (data_type)
+    {
+    case ColumnAttribute::DataType::INT:
+        return sizeof(int32_t);
+    case ColumnAttribute::DataType::TEXT:
+        return 2 * sizeof(u16); // offset and length in the text heap
+    case ColumnAttribute::DataType::BOOLEAN:
+        return sizeof(u_int8_t);
+    default:
+        throw DbRelationError("Only know how to store INT, TEXT and BOOLEAN");
+    }
+}
+
+// Lay out the bitmap and minipages for max_records records. Return where the last minipage ends.
+static u_int32_t lay_out(u_int32_t max_records, const PaxLayout &layout, std::vector<u16> *minipages)
+{
+    u_int32_t offset = PAX_HEADER_SZ + (max_records + 7) / 8;
+    for (auto data_type : layout)
+    {
+        offset = (offset + 3) & ~3U;
+        if (minipages != nullptr)
+            minipages->push_back((u16)offset);
+        offset += max_records * minipage_width(data_type);
+    }
+    return offset;
+}
+
+/**
+ * @class PaxPage - records grouped by column into minipages
+ */
+
+// PaxPage constructor
+PaxPage::PaxPage(Dbt &block, BlockID block_id, const RowLayout &row_layout, bool is_new) : DbBlock(block, block_id),
+                                                                                          row_layout(row_layout),
+                                                                                          layout(row_layout.get_data_types())
+{
+    char *bytes = (char *)this->block.get_data();
+    if (is_new)
+    {
+        this->max_records = capacity(this->block.get_size(), layout);
+        if (this->max_records == 0)
+            throw DbBlockNoRoomError("record does not fit in a block");
+        this->num_records = 0;
+        this->end_free = this->block.get_size() - 1;
+        this->fragmented = 0;
+        this->first_free = 1;
+    }
+    else
+    {
+        this->max_records = *(u16 *)bytes;
+        this->num_records = *(u16 *)(bytes + 2);
+        this->end_free = *(u16 *)(bytes + 4);
+        this->fragmented = *(u16 *)(bytes + 6);
+        this->first_free = *(u16 *)(bytes + 8);
+    }
+    this->bitmap = (u_int8_t *)bytes + PAX_HEADER_SZ;
+    this->minipages_end = lay_out(this->max_records, layout, &this->minipages);
+    if (is_new)
+    {
+        memset(this->bitmap, 0, (this->max_records + 7) / 8);
+        put_header();
+    }
+}
+
+// As many records as fit if each TEXT value is about TEXT_GUESS bytes.
+u_int16_t PaxPage::capacity(u_int32_t block_sz, const PaxLayout &layout)
+{
+    u_int32_t row = 0;
+    for (auto data_type : layout)
+        row += minipage_width(data_type) + (data_type == ColumnAttribute::DataType::TEXT ? TEXT_GUESS : 0);
+    if (row == 0 || block_sz <= PAX_HEADER_SZ)
+        return 0;
+    u_int32_t n = (block_sz - PAX_HEADER_SZ) * 8 / (8 * row + 1);
+    n = std::min(n, (u_int32_t)UINT16_MAX);
+    while (n > 0 && lay_out(n, layout, nullptr) > block_sz)
+        n--;
+    return n;
+}
+
+// Scatter the record's fields into the lowest free slot. Return its id.
+RecordID PaxPage::add(const Dbt *data)
+{
+    if (this->num_records == this->max_records)
+        throw DbBlockNoRoomError("not enough room for new record");
+    u_int32_t needed = text_bytes((const char *)data->get_data());
+    if (needed > text_room())
+        throw DbBlockNoRoomError("not enough room for new record");
+    if (needed > this->end_free + 1U - this->minipages_end)
+        compact();
+    RecordID record_id = this->first_free;
+    while (present(record_id))
+        record_id++;
+    this->bitmap[(record_id - 1) / 8] |= 1 << ((record_id - 1) % 8);
+    scatter(record_id, (const char *)data->get_data());
+    this->num_records++;
+    this->first_free = record_id + 1;
+    put_header();
+    return record_id;
+}
+
+// Get a record from the block (gathered, see view()). Return nullptr if it is not there.
+Dbt *PaxPage::get(RecordID record_id)
+{
+    RecordView record;
+    if (!view(record_id, record))
+        return nullptr;
+    return new Dbt((void *)record.data, record.size);
+}
+
+// Gather the record's fields back into marshaled form. Return false if it is not there.
+bool PaxPage::view(RecordID record_id, RecordView &record)
+{
+    if (!present(record_id))
+        return false;
+    if (this->gathered.empty())
+        this->gathered.resize(this->block.get_size());
+    char *bytes = this->gathered.data();
+    uint offset = this->row_layout.header_size();
+    for (uint col_num = 0; col_num < this->layout.size(); col_num++)
+    {
+        RecordView column;
+        field(record_id, col_num, column);
+        if (this->row_layout.is_variable())
+            ((u16 *)bytes)[col_num] = offset;
+        if (this->layout[col_num] == ColumnAttribute::DataType::TEXT)
+        {
+            *(u16 *)(bytes + offset) = (u16)column.size;
+            offset += sizeof(u16);
+        }
+        memcpy(bytes + offset, column.data, column.size);
+        offset += column.size;
+    }
+    record.data = bytes;
+    record.size = offset;
+    return true;
+}
+
+// Replace a record's fields. Its old text is given up first, so it can be reused for the new text.
+void PaxPage::put(RecordID record_id, const Dbt &data)
+{
+    if (!present(record_id))
+        throw DbRelationError("record has been deleted");
+    u_int32_t old_text = 0;
+    for (uint col_num = 0; col_num < this->layout.size(); col_num++)
+        if (this->layout[col_num] == ColumnAttribute::DataType::TEXT)
+            old_text += *(u16 *)(address(col_num, record_id) + sizeof(u16));
+    u_int32_t needed = text_bytes((const char *)data.get_data());
+    if (needed > text_room() + old_text)
+        throw DbBlockNoRoomError("Not enough room in block");
+    release_text(record_id);
+    if (needed > this->end_free + 1U - this->minipages_end)
+        compact();
+    scatter(record_id, (const char *)data.get_data());
+    put_header();
+}
+
+// Clear the record's bit and give up its text. Its slot is free for the next add().
+void PaxPage::del(RecordID record_id)
+{
+    if (!present(record_id))
+        return;
+    release_text(record_id);
+    this->bitmap[(record_id - 1) / 8] &= ~(1 << ((record_id - 1) % 8));
+    this->num_records--;
+    if (record_id < this->first_free)
+        this->first_free = record_id;
+    put_header();
+}
+
+// Sequence of all present record ids.
+RecordIDs *PaxPage::ids(void)
+{
+    RecordIDs *record_ids = new RecordIDs();
+    RecordID record_id = 0;
+    while (next_id(record_id))
+        record_ids->push_back(record_id);
+    return record_ids;
+}
+
+// Advance record_id to the next present record id (start from 0). Empty bitmap bytes are skipped whole.
+bool PaxPage::next_id(RecordID &record_id)
+{
+    RecordID next = record_id + 1;
+    while (next <= this->max_records)
+    {
+        if ((next - 1) % 8 == 0 && this->bitmap[(next - 1) / 8] == 0)
+        {
+            next += 8;
+            continue;
+        }
+        if (present(next))
+        {
+            record_id = next;
+            return true;
+        }
+        next++;
+    }
+    return false;
+}
+
+// A free slot plus the text heap room. The fixed-size part of a marshaled record always fits in its slot,
+// so that part of the record is counted as available too.
+u_int32_t PaxPage::get_free_space()
+{
+    if (this->num_records == this->max_records)
+        return 0;
+    u_int32_t fixed = 0;
+    for (auto data_type : this->layout)
+        fixed += data_type == ColumnAttribute::DataType::TEXT ? sizeof(u16) : minipage_width(data_type);
+    return fixed + text_room();
+}
+
+// Point at one column of a record.
+bool PaxPage::field(RecordID record_id, uint col_num, RecordView &field)
+{
+    if (!present(record_id))
+        return false;
+    char *entry = address(col_num, record_id);
+    if (this->layout[col_num] == ColumnAttribute::DataType::TEXT)
+    {
+        field.data = (const char *)this->block.get_data() + *(u16 *)entry;
+        field.size = *(u16 *)(entry + sizeof(u16));
+    }
+    else
+    {
+        field.data = entry;
+        field.size = minipage_width(this->layout[col_num]);
+    }
+    return true;
+}
+
+bool PaxPage::present(RecordID record_id)
+{
+    if (record_id == 0 || record_id > this->max_records)
+        return false;
+    return (this->bitmap[(record_id - 1) / 8] >> ((record_id - 1) % 8)) & 1;
+}
+
+// Where a record's entry in a column's minipage is.
+char *PaxPage::address(uint col_num, RecordID record_id)
+{
+    return (char *)this->block.get_data() + this->minipages[col_num] +
+           (record_id - 1) * minipage_width(this->layout[col_num]);
+}
+
+// Total length of the TEXT values in a marshaled record.
+u_int32_t PaxPage::text_bytes(const char *bytes)
+{
+    u_int32_t total = 0;
+    for (uint col_num = 0; col_num < this->layout.size(); col_num++)
+        if (this->layout[col_num] == ColumnAttribute::DataType::TEXT)
+            total += *(u16 *)(bytes + this->row_layout.field_offset(bytes, col_num));
+    return total;
+}
+
+// Text heap bytes an add() could use, counting the holes compact() would recover.
+u_int32_t PaxPage::text_room()
+{
+    return this->end_free + 1U - this->minipages_end + this->fragmented;
+}
+
+// Give up a record's text. Text right at the end of free space just joins it; the rest is a hole until compact().
+void PaxPage::release_text(RecordID record_id)
+{
+    for (uint col_num = 0; col_num < this->layout.size(); col_num++)
+    {
+        if (this->layout[col_num] != ColumnAttribute::DataType::TEXT)
+            continue;
+        char *entry = address(col_num, record_id);
+        u16 loc = *(u16 *)entry;
+        u16 size = *(u16 *)(entry + sizeof(u16));
+        if (size == 0)
+            continue;
+        if (loc == this->end_free + 1U)
+            this->end_free += size;
+        else
+            this->fragmented += size;
+        *(u16 *)(entry + sizeof(u16)) = 0;
+    }
+}
+
+// Copy a marshaled record's fields into their minipages (and its text onto the text heap, which must have room).
+void PaxPage::scatter(RecordID record_id, const char *bytes)
+{
+    for (uint col_num = 0; col_num < this->layout.size(); col_num++)
+    {
+        char *entry = address(col_num, record_id);
+        const char *value = bytes + this->row_layout.field_offset(bytes, col_num);
+        if (this->layout[col_num] == ColumnAttribute::DataType::TEXT)
+        {
+            u16 size = *(u16 *)value;
+            this->end_free -= size;
+            u16 loc = this->end_free + 1U;
+            memcpy((char *)this->block.get_data() + loc, value + sizeof(u16), size);
+            *(u16 *)entry = loc;
+            *(u16 *)(entry + sizeof(u16)) = size;
+        }
+        else
+        {
+            memcpy(entry, value, minipage_width(this->layout[col_num]));
+        }
+    }
+}
+
+// Squeeze the holes out of the text heap, the same way SlottedPage::compact() does for records.
+void PaxPage::compact()
+{
+    std::vector<std::tuple<u16, RecordID, uint>> live; // (loc, record id, column)
+    RecordID record_id = 0;
+    while (next_id(record_id))
+    {
+        for (uint col_num = 0; col_num < this->layout.size(); col_num++)
+        {
+            if (this->layout[col_num] != ColumnAttribute::DataType::TEXT)
+                continue;
+            char *entry = address(col_num, record_id);
+            if (*(u16 *)(entry + sizeof(u16)) != 0)
+                live.push_back(std::make_tuple(*(u16 *)entry, record_id, col_num));
+        }
+    }
+    std::sort(live.begin(), live.end(), std::greater<std::tuple<u16, RecordID, uint>>());
+
+    char *bytes = (char *)this->block.get_data();
+    u_int32_t dest = this->block.get_size();
+    for (auto const &text : live)
+    {
+        char *entry = address(std::get<2>(text), std::get<1>(text));
+        u16 loc = *(u16 *)entry;
+        u16 size = *(u16 *)(entry + sizeof(u16));
+        dest -= size;
+        if (dest != loc)
+        {
+            memmove(bytes + dest, bytes + loc, size);
+            *(u16 *)entry = (u16)dest;
+        }
+    }
+    this->end_free = (u16)(dest - 1);
+    this->fragmented = 0;
+}
+
+void PaxPage::put_header()
+{
+    char *bytes = (char *)this->block.get_data();
+    *(u16 *)bytes = this->max_records;
+    *(u16 *)(bytes + 2) = this->num_records;
+    *(u16 *)(bytes + 4) = this->end_free;
+    *(u16 *)(bytes + 6) = this->fragmented;
+    *(u16 *)(bytes + 8) = this->first_free;
+}
+
+/**
+ * @class PaxHeapFile - HeapFile of PaxPage blocks
+ */
+
+PaxHeapFile::PaxHeapFile(std::string name, const ColumnAttributes &column_attributes, uint block_sz) : HeapFile(name, block_sz),
+                                                                                                     layout(column_attributes) {}
+
+DbBlock *PaxHeapFile::new_block(Dbt &data, BlockID block_id, bool is_new)
+{
+    return new PaxPage(data, block_id, this->layout, is_new);
+}
+
+/**
+ * @class PaxTable - HeapTable kept in PAX pages
+ */
+
+PaxTable::PaxTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                   uint block_sz) : HeapTable(table_name, column_names, column_attributes,
+                                              new PaxHeapFile(table_name, column_attributes, block_sz)) {}
+
+// Check only the where-clause columns, each read from its own minipage.
+bool PaxTable::selected(DbBlock *block, RecordID record_id, const Predicates &predicates)
+{
+    PaxPage *page = (PaxPage *)block;
+    for (uint col_num = 0; col_num < predicates.size(); col_num++)
+    {
+        const Value *value = predicates[col_num];
+        if (value == nullptr)
+            continue;
+        RecordView field;
+        if (!page->field(record_id, col_num, field))
+            return false;
+        switch (this->column_attributes[col_num].get_data_type())
+        {
+        case ColumnAttribute::DataType::INT:
+            if (*(int32_t *)field.data != value->n)
+                return false;
+            break;
+        case ColumnAttribute::DataType::TEXT:
+            if (field.size != value->s.length() || memcmp(field.data, value->s.data(), field.size) != 0)
+                return false;
+            break;
+        case ColumnAttribute::DataType::BOOLEAN:
+            if (*(u_int8_t *)field.data != (value->n != 0))
+                return false;
+            break;
+        default:
+            throw DbRelationError("Only know how to compare INT, TEXT and BOOLEAN");
+        }
+    }
+    return true;
+}
+
+// Read the column from its minipage without touching the rest of each record.
+void PaxTable::gather(DbBlock *block, uint col_num, std::vector<RecordID> &record_ids, std::vector<int32_t> &values)
+{
+    PaxPage *page = (PaxPage *)block;
+    RecordID record_id = 0;
+    RecordView field;
+    while (page->next_id(record_id))
+    {
+        if (!page->field(record_id, col_num, field))
+            continue;
+        record_ids.push_back(record_id);
+        values.push_back(*(int32_t *)field.data);
+    }
+}
+
+// test function -- returns true if all tests pass
+bool test_pax_storage()
+{
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    PaxTable table("_test_pax_cpp", column_names, column_attributes);
+    table.create();
+
+    // fill a few blocks, then grow and shrink rows so the text heap has to be compacted
+    ValueDict row;
+    Handles handles;
+    for (int i = 0; i < 1000; i++)
+    {
+        row["a"] = Value(i);
+        row["b"] = Value(std::string(i % 20, 'a' + i % 26));
+        row["c"] = Value(i % 3 == 0 ? 1 : 0);
+        handles.push_back(table.insert(&row));
+    }
+    bool ok = handles.back().first > 1;
+    for (int i = 0; i < 1000; i += 2)
+        table.del(handles[i]);
+    for (int i = 0; i < 40; i++)
+    {
+        row["a"] = Value(2000 + i);
+        row["b"] = Value(std::string(30, 'z'));
+        row["c"] = Value(1);
+        table.insert(&row);
+    }
+
+    ValueDict where;
+    where["b"] = Value(std::string(19, 'a' + 19 % 26));
+    Handles *found = table.select(&where);
+    ok = ok && found->size() == 4 && found->at(0) == handles[19]; // rows 19, 279, 539 and 799
+    delete found;
+    ValueDict *result = table.project(handles[999]);
+    ok = ok && (*result)["a"].n == 999 && (*result)["b"].s == std::string(19, 'a' + 999 % 26) &&
+         (*result)["c"].n == (999 % 3 == 0);
+    delete result;
+    where.clear();
+    where["c"] = Value(1);
+    found = table.select(&where);
+    uint odd_threes = 0;
+    for (int i = 1; i < 1000; i += 2)
+        odd_threes += i % 3 == 0;
+    ok = ok && found->size() == odd_threes + 40;
+    delete found;
+    table.drop();
+    if (!ok)
+    {
+        std::cout << "Wrong PAX table rows" << std::endl;
+        return false;
+    }
+    return true;
+}
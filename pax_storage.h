@@ -0,0 +1,175 @@
+/**
+ * @file pax_storage.h - PAX (Partition Attributes Across) pages: rows on one page, stored column by column.
+ * PaxPage: DbBlock
+ * PaxHeapFile: HeapFile
+ * PaxTable: HeapTable
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * column types of a PaxPage, in column order
+ */
+typedef std::vector<ColumnAttribute::DataType> PaxLayout;
+
+/**
+ * @class PaxPage - block holding whole records, grouped by column into minipages (implementation of DbBlock)
+ *
+ *      add() and put() take records marshaled by HeapTable (see RowLayout) and scatter their fields: minipage c holds
+        column c of every record, so a scan of one column reads one contiguous array. INT and BOOLEAN
+        values are stored in place; a TEXT minipage holds (offset, length) pairs pointing into a text heap
+        that grows down from the end of the block. The number of record slots is fixed when the block is
+        made. Which slots hold a record is kept in a bitmap; record ids start at 1.
+            Bytes 0x00 - 0x01: number of record slots
+            Bytes 0x02 - 0x03: number of records present
+            Bytes 0x04 - 0x05: offset to end of free space (the text heap starts right after)
+            Bytes 0x06 - 0x07: number of fragmented text heap bytes (left behind by del() and put())
+            Bytes 0x08 - 0x09: no record id below this one is free (hint for add())
+            Bytes 0x0A - ...: presence bitmap, then the minipages (each starting on a 4-byte boundary)
+        view() gathers a record back into the marshaled form in a buffer owned by the page, which is
+        good until the next view() of the same page. field() points straight at one column of a record.
+ */
+class PaxPage : public DbBlock
+{
+public:
+    /**
+     * bytes of text assumed per TEXT value when deciding how many records a new block gets
+     */
+    static const uint TEXT_GUESS = 16;
+
+    PaxPage(Dbt &block, BlockID block_id, const RowLayout &row_layout, bool is_new = false);
+
+    virtual ~PaxPage() {}
+
+    PaxPage(const PaxPage &other) = delete;
+
+    PaxPage(PaxPage &&temp) = delete;
+
+    PaxPage &operator=(const PaxPage &other) = delete;
+
+    PaxPage &operator=(PaxPage &temp) = delete;
+
+    virtual RecordID add(const Dbt *data);
+
+    virtual Dbt *get(RecordID record_id);
+
+    /**
+     * Gather the record into the page's one view buffer. The previous view of this page is overwritten,
+     * so callers finish with one record (or copy it) before viewing the next.
+     */
+    virtual bool view(RecordID record_id, RecordView &record);
+
+    virtual void put(RecordID record_id, const Dbt &data);
+
+    virtual void del(RecordID record_id);
+
+    virtual RecordIDs *ids(void);
+
+    virtual bool next_id(RecordID &record_id);
+
+    virtual u_int32_t get_free_space();
+
+    /**
+     * Point field at one column of a record: the 4-byte INT, the 1-byte BOOLEAN, or the TEXT bytes.
+     * @param record_id  which record
+     * @param col_num    which column
+     * @param field      returned by reference: the column's bytes inside the block
+     * @returns          false if there is no such record
+     */
+    virtual bool field(RecordID record_id, uint col_num, RecordView &field);
+
+    /**
+     * Number of record slots a new block gets for this layout.
+     */
+    static u_int16_t capacity(u_int32_t block_sz, const PaxLayout &layout);
+
+protected:
+    const RowLayout &row_layout; // how records are marshaled
+    const PaxLayout &layout;
+    u_int16_t max_records;
+    u_int16_t num_records;
+    u_int16_t end_free;
+    u_int16_t fragmented;
+    u_int16_t first_free;
+    u_int8_t *bitmap;
+    std::vector<u_int16_t> minipages; // offset of each column's minipage
+    u_int32_t minipages_end;
+    std::vector<char> gathered;       // view() buffer
+
+    virtual bool present(RecordID record_id);
+
+    virtual char *address(uint col_num, RecordID record_id);
+
+    virtual u_int32_t text_bytes(const char *bytes);
+
+    virtual u_int32_t text_room();
+
+    virtual void release_text(RecordID record_id);
+
+    virtual void scatter(RecordID record_id, const char *bytes);
+
+    virtual void compact();
+
+    virtual void put_header();
+};
+
+/**
+ * @class PaxHeapFile - HeapFile of PaxPage blocks
+ */
+class PaxHeapFile : public HeapFile
+{
+public:
+    PaxHeapFile(std::string name, const ColumnAttributes &column_attributes, uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~PaxHeapFile() {}
+
+    PaxHeapFile(const PaxHeapFile &other) = delete;
+
+    PaxHeapFile(PaxHeapFile &&temp) = delete;
+
+    PaxHeapFile &operator=(const PaxHeapFile &other) = delete;
+
+    PaxHeapFile &operator=(PaxHeapFile &&temp) = delete;
+
+protected:
+    RowLayout layout;
+
+    virtual DbBlock *new_block(Dbt &data, BlockID block_id, bool is_new);
+};
+
+/**
+ * @class PaxTable - HeapTable kept in PAX pages (CREATE TABLE ... USING PAX)
+ *
+ *      Rows are marshaled just as for HeapTable; the pages do the rearranging. Where-clauses are
+        checked a column at a time straight from the minipages, and the INT column a scan filters a
+        page at a time is copied straight out of its minipage.
+ */
+class PaxTable : public HeapTable
+{
+public:
+    PaxTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+             uint block_sz = DbBlock::BLOCK_SZ);
+
+    virtual ~PaxTable() {}
+
+    PaxTable(const PaxTable &other) = delete;
+
+    PaxTable(PaxTable &&temp) = delete;
+
+    PaxTable &operator=(const PaxTable &other) = delete;
+
+    PaxTable &operator=(PaxTable &&temp) = delete;
+
+protected:
+    using HeapTable::selected;
+
+    virtual bool selected(DbBlock *block, RecordID record_id, const Predicates &predicates);
+
+    virtual void gather(DbBlock *block, uint col_num, std::vector<RecordID> &record_ids, std::vector<int32_t> &values);
+};
+
+bool test_pax_storage();
@@ -4,7 +4,12 @@
  * @see "Seattle University, CPSC5300, Spring 2022"
  */
 #include "schema_tables.h"
+#include <algorithm>
 #include "ParseTreeToString.h"
+#include "mmap_page_file.h"
+#include "fixed_heap_storage.h"
+#include "columnar_storage.h"
+#include "pax_storage.h"
 
 void initialize_schema_tables()
 {
@@ -44,6 +49,16 @@ bool is_acceptable_data_type(std::string dt)
     return dt == "INT" || dt == "TEXT" || dt == "BOOLEAN"; // for now
 }
 
+bool is_acceptable_storage(std::string storage)
+{
+    return storage == "HEAP" || storage == "MMAP" || storage == "COLUMNAR" || storage == "PAX";
+}
+
+bool is_acceptable_page_size(int32_t page_size)
+{
+    return page_size > 0 && DbBlock::is_valid_size((uint)page_size);
+}
+
 /*
  * ***************************
  * Tables class implementation
@@ -52,13 +67,19 @@ bool is_acceptable_data_type(std::string dt)
 const Identifier Tables::TABLE_NAME = "_tables";
 Columns *Tables::columns_table = nullptr;
 std::map<Identifier, DbRelation *> Tables::table_cache;
+std::map<Identifier, Tables::TableInfo> Tables::catalog;
+bool Tables::catalog_loaded = false;
 
 // get the column name for _tables column
 ColumnNames &Tables::COLUMN_NAMES()
 {
     static ColumnNames cn;
     if (cn.empty())
+    {
         cn.push_back("table_name");
+        cn.push_back("storage");
+        cn.push_back("page_size");
+    }
     return cn;
 }
 
@@ -69,12 +90,15 @@ ColumnAttributes &Tables::COLUMN_ATTRIBUTES()
     if (cas.empty())
     {
         ColumnAttribute ca(ColumnAttribute::TEXT);
-        cas.push_back(ca);
+        cas.push_back(ca); // table_name
+        cas.push_back(ca); // storage
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca); // page_size
     }
     return cas;
 }
 
-// ctor - we have a fixed table structure of just one column: table_name
+// ctor - we have a fixed table structure: table_name, storage, page_size
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES())
 {
     Tables::table_cache[TABLE_NAME] = this;
@@ -88,6 +112,8 @@ void Tables::create()
 {
     HeapTable::create();
     ValueDict row;
+    row["storage"] = Value("HEAP");
+    row["page_size"] = Value((int32_t)DbBlock::BLOCK_SZ);
     row["table_name"] = Value("_tables");
     insert(&row);
     row["table_name"] = Value("_columns");
@@ -99,15 +125,29 @@ void Tables::create()
 // Manually check that table_name is unique.
 Handle Tables::insert(const ValueDict *row)
 {
+    if (!is_acceptable_storage(row->at("storage").s))
+        throw DbRelationError("unacceptable storage '" + row->at("storage").s + "'");
+    if (!is_acceptable_page_size(row->at("page_size").n))
+        throw DbRelationError("unacceptable page size " + std::to_string(row->at("page_size").n));
+
     // Try SELECT * FROM _tables WHERE table_name = row["table_name"] and it should return nothing
-    Handles *handles = select(row);
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    Handles *handles = select(&where);
     bool unique = handles->empty();
     delete handles;
     if (!unique)
         throw DbRelationError(row->at("table_name").s + " already exists");
+    invalidate_catalog();
     return HeapTable::insert(row);
 }
 
+// One row at a time, so every row gets the uniqueness check above.
+Handles *Tables::insert_batch(const ValueDicts &rows)
+{
+    return DbRelation::insert_batch(rows);
+}
+
 // Remove a row, but first remove from table cache if there
 // NOTE: once the row is deleted, any reference to the table (from get_table() below) is gone! So drop the table first.
 void Tables::del(Handle handle)
@@ -123,42 +163,106 @@ void Tables::del(Handle handle)
         delete table;
     }
 
+    invalidate_catalog();
     HeapTable::del(handle);
 }
 
 // Return a list of column names and column attributes for given table.
 void Tables::get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes)
 {
-    // SELECT * FROM _columns WHERE table_name = <table_name>
-    ValueDict where;
-    where["table_name"] = table_name;
-    Handles *handles = Tables::columns_table->select(&where);
+    load_catalog();
+    std::map<Identifier, TableInfo>::const_iterator it = Tables::catalog.find(table_name);
+    if (it == Tables::catalog.end())
+        return;
+    column_names.insert(column_names.end(), it->second.column_names.begin(), it->second.column_names.end());
+    column_attributes.insert(column_attributes.end(), it->second.column_attributes.begin(),
+                             it->second.column_attributes.end());
+}
 
-    ColumnAttribute column_attribute;
-    for (auto const &handle : *handles)
+// SELECT * FROM _tables, then SELECT * FROM _columns, filed by table name.
+// (read through a Row, so no ValueDict gets built per row)
+void Tables::load_catalog()
+{
+    if (Tables::catalog_loaded)
+        return;
+    Tables::catalog.clear();
+
+    DbRelation *tables = Tables::table_cache.at(TABLE_NAME);
+    const ColumnNames &table_columns = tables->get_column_names();
+    uint table_col = std::find(table_columns.begin(), table_columns.end(), "table_name") - table_columns.begin();
+    uint storage_col = std::find(table_columns.begin(), table_columns.end(), "storage") - table_columns.begin();
+    uint page_size_col = std::find(table_columns.begin(), table_columns.end(), "page_size") - table_columns.begin();
+    const ColumnNames &column_columns = Tables::columns_table->get_column_names();
+    uint owner_col = std::find(column_columns.begin(), column_columns.end(), "table_name") - column_columns.begin();
+    uint name_col = std::find(column_columns.begin(), column_columns.end(), "column_name") - column_columns.begin();
+    uint type_col = std::find(column_columns.begin(), column_columns.end(), "data_type") - column_columns.begin();
+
+    Row row;
+    Handle handle;
+    DbRelationCursor *cursor = tables->cursor();
+    try
     {
-        ValueDict *row = Tables::columns_table->project(
-            handle); // get the row's values: {'column_name': <name>, 'data_type': <type>}
-
-        Identifier column_name = (*row)["column_name"].s;
-        column_names.push_back(column_name);
+        while (cursor->next(handle))
+        {
+            cursor->project(row); // the row's values: (table_name, storage, page_size)
+            TableInfo &info = Tables::catalog[row.get_text(table_col)];
+            info.storage = row.get_text(storage_col);
+            info.page_size = row.get_int(page_size_col);
+        }
+        delete cursor;
+        cursor = Tables::columns_table->cursor();
+
+        ColumnAttribute column_attribute;
+        while (cursor->next(handle))
+        {
+            cursor->project(row); // the row's values: (table_name, column_name, data_type)
+            TableInfo &info = Tables::catalog[row.get_text(owner_col)];
+            info.column_names.push_back(row.get_text(name_col));
+
+            ColumnAttribute::DataType data_type;
+            std::string type = row.get_text(type_col);
+            if (type == "INT")
+                data_type = ColumnAttribute::INT;
+            else if (type == "TEXT")
+                data_type = ColumnAttribute::TEXT;
+            else if (type == "BOOLEAN")
+                data_type = ColumnAttribute::BOOLEAN;
+            else
+                throw DbRelationError("Unknown data type");
+            column_attribute.set_data_type(data_type);
+
+            info.column_attributes.push_back(column_attribute);
+        }
+    }
+    catch (...)
+    {
+        delete cursor;
+        Tables::catalog.clear();
+        throw;
+    }
+    delete cursor;
+    Tables::catalog_loaded = true;
+}
 
-        ColumnAttribute::DataType data_type;
-        if ((*row)["data_type"].s == "INT")
-            data_type = ColumnAttribute::INT;
-        else if ((*row)["data_type"].s == "TEXT")
-            data_type = ColumnAttribute::TEXT;
-        else if ((*row)["data_type"].s == "BOOLEAN")
-            data_type = ColumnAttribute::BOOLEAN;
-        else
-            throw DbRelationError("Unknown data type");
-        column_attribute.set_data_type(data_type);
+void Tables::invalidate_catalog()
+{
+    Tables::catalog.clear();
+    Tables::catalog_loaded = false;
+}
 
-        column_attributes.push_back(column_attribute);
+// The cached tables keep their dirty blocks until they are written back, so this is what makes a
+// statement's changes visible to the next process.
+void Tables::flush_all()
+{
+    for (auto const &entry : Tables::table_cache)
+        entry.second->flush();
+}
 
-        delete row;
-    }
-    delete handles;
+// Closing writes everything back, the same as flush_all(), and lets go of the files.
+void Tables::close_all()
+{
+    for (auto const &entry : Tables::table_cache)
+        entry.second->close();
 }
 
 // Return a table for given table_name.
@@ -168,11 +272,29 @@ DbRelation &Tables::get_table(Identifier table_name)
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
         return *Tables::table_cache[table_name];
 
-    // otherwise assume it is a HeapTable (for now)
-    ColumnNames column_names;
-    ColumnAttributes column_attributes;
-    get_columns(table_name, column_names, column_attributes);
-    DbRelation *table = new HeapTable(table_name, column_names, column_attributes);
+    // SELECT storage, page_size FROM _tables WHERE table_name = <table_name> (from the catalog)
+    load_catalog();
+    std::map<Identifier, TableInfo>::const_iterator it = Tables::catalog.find(table_name);
+    if (it == Tables::catalog.end() || it->second.storage.empty())
+        throw DbRelationError(table_name + " does not exist");
+    const Identifier &storage = it->second.storage;
+    uint page_size = it->second.page_size;
+    const ColumnNames &column_names = it->second.column_names;
+    const ColumnAttributes &column_attributes = it->second.column_attributes;
+
+    // otherwise it is a ColumnarTable or a HeapTable, on whichever kind of file it was created with
+    // (heap tables with only fixed-width columns get the simpler FixedHeapTable)
+    DbRelation *table;
+    if (storage == "COLUMNAR")
+        table = new ColumnarTable(table_name, column_names, column_attributes, page_size);
+    else if (storage == "PAX")
+        table = new PaxTable(table_name, column_names, column_attributes, page_size);
+    else if (storage == "MMAP")
+        table = new HeapTable(table_name, column_names, column_attributes, new MmapPageFile(table_name, page_size));
+    else if (FixedHeapTable::record_size(column_attributes) != 0)
+        table = new FixedHeapTable(table_name, column_names, column_attributes, page_size);
+    else
+        table = new HeapTable(table_name, column_names, column_attributes, new HeapFile(table_name, page_size));
     Tables::table_cache[table_name] = table;
     return *table;
 }
@@ -225,6 +347,12 @@ void Columns::create()
     row["table_name"] = Value("_tables");
     row["column_name"] = Value("table_name");
     insert(&row);
+    row["column_name"] = Value("storage");
+    insert(&row);
+    row["column_name"] = Value("page_size");
+    row["data_type"] = Value("INT");
+    insert(&row);
+    row["data_type"] = Value("TEXT");
     row["table_name"] = Value("_columns");
     row["column_name"] = Value("table_name");
     insert(&row);
@@ -272,9 +400,23 @@ Handle Columns::insert(const ValueDict *row)
     if (!unique)
         throw DbRelationError("duplicate column " + row->at("table_name").s + "." + row->at("column_name").s);
 
+    Tables::invalidate_catalog();
     return HeapTable::insert(row);
 }
 
+// One row at a time, so every row gets the checks above.
+Handles *Columns::insert_batch(const ValueDicts &rows)
+{
+    return DbRelation::insert_batch(rows);
+}
+
+// The table whose column this was has changed shape.
+void Columns::del(Handle handle)
+{
+    Tables::invalidate_catalog();
+    HeapTable::del(handle);
+}
+
 /*
  * ****************************
  * Indices class implementation
@@ -347,6 +489,12 @@ Handle Indices::insert(const ValueDict *row)
     return HeapTable::insert(row);
 }
 
+// One row at a time, so every row gets the uniqueness check above.
+Handles *Indices::insert_batch(const ValueDicts &rows)
+{
+    return DbRelation::insert_batch(rows);
+}
+
 // Remove a row, but first remove from index cache if there
 // NOTE: once the row is deleted, any reference to the index (from get_index() below) is gone! So drop the index
 void Indices::del(Handle handle)
@@ -376,12 +524,11 @@ void Indices::get_columns(Identifier table_name, Identifier index_name, ColumnNa
     where["index_name"] = index_name;
     Handles *handles = select(&where);
 
+    ValueDicts *rows = project_many(*handles);
     Identifier colnames[DbIndex::MAX_COMPOSITE];
     uint size = 0;
-    for (auto const &handle : *handles)
+    for (auto const &row : *rows)
     {
-        ValueDict *row = project(handle);
-
         Identifier column_name = (*row)["column_name"].s;
         uint which = (uint)(*row)["seq_in_index"].n;
         colnames[which - 1] = column_name; // seq_in_index is 1-based
@@ -393,6 +540,7 @@ void Indices::get_columns(Identifier table_name, Identifier index_name, ColumnNa
     }
     for (uint i = 0; i < size; i++)
         column_names.push_back(colnames[i]);
+    delete rows;
     delete handles;
 }
 
@@ -417,6 +565,13 @@ public:
     void del(Handle handle) {}
 };
 
+// Before the program exits, like Tables::close_all().
+void Indices::close_all()
+{
+    for (auto const &entry : Indices::index_cache)
+        entry.second->close();
+}
+
 // Return a table for given table_name.
 DbIndex &Indices::get_index(Identifier table_name, Identifier index_name)
 {
@@ -450,12 +605,13 @@ IndexNames Indices::get_index_names(Identifier table_name)
     where["table_name"] = Value(table_name);
     where["seq_in_index"] = Value(1); // only get the row for the first column if composite index
     Handles *handles = select(&where);
-    for (auto const &handle : *handles)
+    ValueDicts *rows = project_many(*handles);
+    for (auto const &row : *rows)
     {
-        ValueDict *row = project(handle);
         ret.push_back((*row)["index_name"].s);
         delete row;
     }
+    delete rows;
     delete handles;
     return ret;
 }
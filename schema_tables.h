@@ -41,6 +41,8 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual Handles *insert_batch(const ValueDicts &rows);
+
     virtual void del(Handle handle);
 
     /**
@@ -60,6 +62,16 @@ public:
      */
     static DbRelation &get_table(Identifier table_name);
 
+    /**
+     * Write back every table get_table() has handed out (the schema tables included).
+     */
+    static void flush_all();
+
+    /**
+     * Close every table get_table() has handed out (the schema tables included), before the program exits.
+     */
+    static void close_all();
+
 protected:
     // hard-coded columns for _tables table
     static ColumnNames &COLUMN_NAMES();
@@ -69,9 +81,34 @@ protected:
     // keep a reference to the columns table (for get_columns method)
     static Columns *columns_table;
 
+    friend class Columns;
+
+    // what get_table() needs to know about a table, from its _tables row and its _columns rows
+    struct TableInfo
+    {
+        Identifier storage;
+        uint page_size;
+        ColumnNames column_names;
+        ColumnAttributes column_attributes;
+    };
+
+    /**
+     * Read _tables and _columns once each and remember every table's info, so opening
+     * a table needs no scan of either (done on first use after any change to them).
+     */
+    static void load_catalog();
+
+    /**
+     * Forget the remembered table info (after _tables or _columns changes).
+     */
+    static void invalidate_catalog();
+
 private:
     // keep a cache of all the tables we've instantiated so far
     static std::map<Identifier, DbRelation *> table_cache;
+
+    static std::map<Identifier, TableInfo> catalog;
+    static bool catalog_loaded;
 };
 
 /**
@@ -95,6 +132,10 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual Handles *insert_batch(const ValueDicts &rows);
+
+    virtual void del(Handle handle);
+
 protected:
     // hard-coded columns for the _columns table
     static ColumnNames &COLUMN_NAMES();
@@ -138,6 +179,11 @@ public:
      */
     virtual DbIndex &get_index(Identifier table_name, Identifier index_name);
 
+    /**
+     * Close every index get_index() has handed out.
+     */
+    static void close_all();
+
     /**
      * Get the list of indices on a given table.
      * @param table_name  which table to lookup the indices on
@@ -148,6 +194,8 @@ public:
     // overrides
     virtual Handle insert(const ValueDict *row);
 
+    virtual Handles *insert_batch(const ValueDicts &rows);
+
     virtual void del(Handle handle);
 
 protected:
@@ -116,6 +116,7 @@ int yyerror(YYLTYPE* llocp, SQLParserResult** result, yyscan_t scanner, const ch
 	hsql::PrepareStatement* prep_stmt;
 	hsql::ExecuteStatement* exec_stmt;
 	hsql::ShowStatement*    show_stmt;
+	hsql::VacuumStatement*  vacuum_stmt;
 
 	hsql::TableRef* table;
 	hsql::Expr* expr;
@@ -169,7 +170,7 @@ int yyerror(YYLTYPE* llocp, SQLParserResult** result, yyscan_t scanner, const ch
 %token SPATIAL VIRTUAL BEFORE COLUMN CREATE DELETE DIRECT
 %token DOUBLE ESCAPE EXCEPT EXISTS GLOBAL HAVING IMPORT
 %token INSERT ISNULL OFFSET RENAME SCHEMA SELECT SORTED
-%token TABLES UNIQUE UNLOAD UPDATE VALUES AFTER ALTER BTREE CROSS
+%token TABLES UNIQUE UNLOAD UPDATE VACUUM VALUES AFTER ALTER BTREE CROSS
 %token DELTA GROUP INDEX INNER LIMIT LOCAL MERGE MINUS ORDER
 %token OUTER RIGHT TABLE UNION USING WHERE CALL CASE DATE
 %token DESC DROP ELSE FILE FROM FULL HASH HINT INTO JOIN
@@ -192,7 +193,8 @@ int yyerror(YYLTYPE* llocp, SQLParserResult** result, yyscan_t scanner, const ch
 %type <update_stmt> update_statement
 %type <drop_stmt>	drop_statement
 %type <show_stmt>	show_statement
-%type <sval> 		table_name opt_alias alias file_path index_name
+%type <vacuum_stmt>	vacuum_statement
+%type <sval> 		table_name opt_alias alias file_path index_name opt_storage_type
 %type <ssval>       opt_using_type
 %type <bval> 		opt_not_exists opt_distinct
 %type <uval>		import_file_type opt_join_type column_type
@@ -277,6 +279,7 @@ preparable_statement:
 	|	update_statement { $$ = $1; }
 	|	drop_statement { $$ = $1; }
 	|   show_statement { $$ = $1; }
+	|	vacuum_statement { $$ = $1; }
 	|	execute_statement { $$ = $1; }
 	;
 
@@ -333,6 +336,7 @@ file_path:
 /******************************
  * Create Statement
  * CREATE TABLE students (name TEXT, student_number INTEGER, city TEXT, grade DOUBLE)
+ * CREATE TABLE students (name TEXT, student_number INTEGER) USING MMAP
  * CREATE TABLE students FROM TBL FILE 'test/students.tbl'
  ******************************/
 create_statement:
@@ -342,11 +346,20 @@ create_statement:
 			$$->tableName = $4;
 			$$->filePath = $8;
 		}
-	|	CREATE TABLE opt_not_exists table_name '(' column_def_commalist ')' {
+	|	CREATE TABLE opt_not_exists table_name '(' column_def_commalist ')' opt_storage_type {
 			$$ = new CreateStatement(CreateStatement::kTable);
 			$$->ifNotExists = $3;
 			$$->tableName = $4;
 			$$->columns = $6;
+			$$->storageType = $8;
+		}
+	|	CREATE TABLE opt_not_exists table_name '(' column_def_commalist ')' USING IDENTIFIER '(' INTVAL ')' {
+			$$ = new CreateStatement(CreateStatement::kTable);
+			$$->ifNotExists = $3;
+			$$->tableName = $4;
+			$$->columns = $6;
+			$$->storageType = $9;
+			$$->pageSize = $11;
 		}
 	|	CREATE VIEW opt_not_exists table_name opt_column_list AS select_statement {
 			$$ = new CreateStatement(CreateStatement::kView);
@@ -369,6 +382,11 @@ opt_using_type:
     |   USING HASH { $$ = "HASH"; }
     |   /* empty */ { $$ = "BTREE"; }
 
+opt_storage_type:
+        USING IDENTIFIER { $$ = $2; }
+    |   /* empty */ { $$ = NULL; }
+    ;
+
 opt_not_exists:
 		IF NOT EXISTS { $$ = true; }
 	|	/* empty */ { $$ = false; }
@@ -448,6 +466,18 @@ show_statement:
         }
 	;
 
+/******************************
+ * Vacuum Statement
+ * VACUUM students;
+ ******************************/
+
+vacuum_statement:
+		VACUUM table_name {
+			$$ = new VacuumStatement();
+			$$->tableName = $2;
+		}
+	;
+
 /******************************
  * Delete Statement / Truncate statement
  * DELETE FROM students WHERE grade > 3.0
@@ -33,6 +33,8 @@ namespace hsql {
 
   // Represents SQL Create statements.
   // Example: "CREATE TABLE students (name TEXT, student_number INTEGER, city TEXT, grade DOUBLE)"
+  //          "CREATE TABLE students (name TEXT, student_number INTEGER) USING MMAP"
+  //          "CREATE TABLE students (name TEXT, student_number INTEGER) USING HEAP(16384)"
   struct CreateStatement : SQLStatement {
     enum CreateType {
       kTable,
@@ -50,6 +52,8 @@ namespace hsql {
     char* tableName; // default: NULL
     char* indexName; // default: NULL
     char* indexType; // default: NULL
+    char* storageType; // default: NULL
+    int64_t pageSize; // default: 0
     std::vector<ColumnDefinition*>* columns; // default: NULL
     std::vector<char*>* viewColumns;
     std::vector<char*>* indexColumns;
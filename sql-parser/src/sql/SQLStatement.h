@@ -20,6 +20,7 @@ namespace hsql {
     kStmtRename,
     kStmtAlter,
     kStmtShow,
+    kStmtVacuum,
   };
 
   /**
@@ -0,0 +1,18 @@
+#ifndef __VACUUM_STATEMENT_H__
+#define __VACUUM_STATEMENT_H__
+
+#include "SQLStatement.h"
+
+// Note: Implementations of constructors and destructors can be found in statements.cpp.
+namespace hsql {
+    // Represents SQL-extension Vacuum statements.
+    // Example "VACUUM students;"
+    struct VacuumStatement : SQLStatement {
+        VacuumStatement();
+        virtual ~VacuumStatement();
+
+        char* tableName;
+    };
+
+} // namespace hsql
+#endif
\ No newline at end of file
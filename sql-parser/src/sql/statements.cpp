@@ -41,12 +41,15 @@ namespace hsql {
     viewColumns(NULL),
     indexName(NULL),
     indexType(NULL),
+    storageType(NULL),
+    pageSize(0),
     select(NULL) {};
 
   CreateStatement::~CreateStatement() {
     free(filePath);
     free(tableName);
     free(indexName);
+    free(storageType);
     delete select;
 
     if (columns != NULL) {
@@ -311,4 +314,13 @@ namespace hsql {
     free(tableName);
   }
 
+  // VacuumStatement
+  VacuumStatement::VacuumStatement() :
+          SQLStatement(kStmtVacuum),
+          tableName(NULL) {}
+
+  VacuumStatement::~VacuumStatement() {
+    free(tableName);
+  }
+
 } // namespace hsql
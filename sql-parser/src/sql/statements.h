@@ -11,5 +11,6 @@
 #include "PrepareStatement.h"
 #include "ExecuteStatement.h"
 #include "ShowStatement.h"
+#include "VacuumStatement.h"
 
 #endif // __STATEMENTS_H__ 
\ No newline at end of file
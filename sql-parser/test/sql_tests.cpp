@@ -111,6 +111,21 @@ TEST(DropTableStatementTest) {
 }
 
 
+TEST(VacuumStatementTest) {
+  TEST_PARSE_SINGLE_SQL(
+    "VACUUM students",
+    kStmtVacuum,
+    VacuumStatement,
+    result,
+    stmt);
+
+  ASSERT_NOTNULL(stmt->tableName);
+  ASSERT_STREQ(stmt->tableName, "students");
+
+  delete result;
+}
+
+
 TEST(PrepareStatementTest) {
   std::string query = "PREPARE test {"
                       "INSERT INTO test VALUES(?);"
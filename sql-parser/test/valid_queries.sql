@@ -35,6 +35,8 @@ UPDATE students SET grade = 1.3, name='Felix Fürstenberg' WHERE name = 'Max Mus
 UPDATE students SET grade = 1.0;
 # DROP
 DROP TABLE students;
+# VACUUM
+VACUUM students;
 # PREPARE
 PREPARE prep_inst: INSERT INTO test VALUES (?, ?, ?);
 PREPARE prep2 { INSERT INTO test VALUES (?, 0, 0); INSERT INTO test VALUES (0, ?, 0); INSERT INTO test VALUES (0, 0, ?); };
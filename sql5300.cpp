@@ -2,9 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <iostream>
+#include <sstream>
 #include "db_cxx.h"
 #include "SQLParser.h"
+#include "SQLExec.h"
 #include "heap_storage.h"
+#include "fixed_heap_storage.h"
+#include "columnar_storage.h"
+#include "pax_storage.h"
 
 // we allocate and initialize the _DB_ENV global
 DbEnv *_DB_ENV;
@@ -48,6 +53,7 @@ int main(int argc, char *argv[])
         exit(1);
     }
     _DB_ENV = &env;
+    initialize_schema_tables();
 
     // SQL entry
     while (true)
@@ -64,14 +70,17 @@ int main(int argc, char *argv[])
         {
             cout << "test_slotted_page: " << (test_slotted_page() ? "Pass" : "Failed") << endl;
             cout << "test_heap_storage: " << (test_heap_storage() ? "Pass" : "Failed") << endl;
+            cout << "test_fixed_heap_storage: " << (test_fixed_heap_storage() ? "Pass" : "Failed") << endl;
+            cout << "test_columnar_storage: " << (test_columnar_storage() ? "Pass" : "Failed") << endl;
+            cout << "test_pax_storage: " << (test_pax_storage() ? "Pass" : "Failed") << endl;
             continue;
         }
-        if (query == "test2" || query == "test table")
+        if (sql == "test2" || sql == "test table")
         {
             cout << "Testing SQL executor:\n " << (test_sqlexec_table() ? "Tests passed" : "Tests failed") << endl;
             continue;
         }
-        if (query == "test3" || query == "test index")
+        if (sql == "test3" || sql == "test index")
         {
             cout << "Testing SQL executor:\n " << (test_sqlexec_index() ? "Tests passed" : "Tests failed") << endl;
             continue;
@@ -96,6 +105,7 @@ int main(int argc, char *argv[])
             delete parser;
         }
     }
+    SQLExec::shutdown(); // the tables cache their blocks, so close them before we go
     return EXIT_SUCCESS;
 }
 
@@ -115,6 +125,21 @@ string execute(const SQLStatement *stmt)
     case kStmtCreate:
         str += printCreate((const CreateStatement *)stmt);
         break;
+    case kStmtVacuum:
+        // this one really runs, so the table ends up packed
+        try
+        {
+            QueryResult *result = SQLExec::execute(stmt);
+            ostringstream out;
+            out << *result;
+            delete result;
+            str += out.str();
+        }
+        catch (SQLExecError &e)
+        {
+            str += string("Error: ") + e.what();
+        }
+        break;
     /*We don't need these functions now
     case kStmtInsert:
         printInsertStatementInfo((const InsertStatement *)stmt, 0);
@@ -19,6 +19,12 @@ bool Value::operator!=(const Value &other) const
     return !(*this == other);
 }
 
+// Both HeapFile and the _tables schema check page sizes here, so they always agree.
+bool DbBlock::is_valid_size(uint block_sz)
+{
+    return block_sz >= BLOCK_SZ && block_sz <= MAX_BLOCK_SZ && (block_sz & (block_sz - 1)) == 0;
+}
+
 // Just pulls out the column names from a ValueDict and passes that to the usual form of project().
 ValueDict *DbRelation::project(Handle handle, const ValueDict *where)
 {
@@ -27,3 +33,189 @@ ValueDict *DbRelation::project(Handle handle, const ValueDict *where)
         t.push_back(column.first);
     return this->project(handle, &t);
 }
+
+// Just inserts the rows one at a time. Storage engines that can do better override this.
+Handles *DbRelation::insert_batch(const ValueDicts &rows)
+{
+    Handles *handles = new Handles();
+    for (auto const &row : rows)
+        handles->push_back(this->insert(row));
+    return handles;
+}
+
+// Just projects through a cursor, on this thread. Storage engines that can do better override this.
+ValueDicts *DbRelation::scan(const ValueDict *where, const ColumnNames *column_names, uint parallelism)
+{
+    if (column_names == nullptr)
+        column_names = &this->column_names;
+    ValueDicts *rows = new ValueDicts();
+    DbRelationCursor *cursor = this->cursor(where);
+    try
+    {
+        Handle handle;
+        while (cursor->next(handle))
+            rows->push_back(cursor->project(column_names));
+    }
+    catch (...)
+    {
+        delete cursor;
+        for (auto row : *rows)
+            delete row;
+        delete rows;
+        throw;
+    }
+    delete cursor;
+    return rows;
+}
+
+// Just projects the rows one at a time. Storage engines that can do better override this.
+ValueDicts *DbRelation::project_many(const Handles &handles, const ColumnNames *column_names)
+{
+    if (column_names == nullptr)
+        column_names = &this->column_names;
+    ValueDicts *rows = new ValueDicts();
+    try
+    {
+        for (auto const &handle : handles)
+            rows->push_back(this->project(handle, column_names));
+    }
+    catch (...)
+    {
+        for (auto row : *rows)
+            delete row;
+        delete rows;
+        throw;
+    }
+    return rows;
+}
+
+// Just scans on this thread. Storage engines that can split the scan override this.
+Handles *DbRelation::select(const ValueDict *where, uint parallelism)
+{
+    return this->select(where);
+}
+
+// Just converts to a ValueDict and uses the usual insert(). Storage engines that can do better override this.
+Handle DbRelation::insert(const Row &row)
+{
+    ValueDict *values = to_value_dict(row);
+    try
+    {
+        Handle handle = this->insert(values);
+        delete values;
+        return handle;
+    }
+    catch (...)
+    {
+        delete values;
+        throw;
+    }
+}
+
+// Just converts the usual project(). Storage engines that can do better override this.
+void DbRelation::project(Handle handle, Row &row)
+{
+    ValueDict *values = this->project(handle);
+    try
+    {
+        to_row(*values, row);
+    }
+    catch (...)
+    {
+        delete values;
+        throw;
+    }
+    delete values;
+}
+
+// Every column has to be in values.
+void DbRelation::to_row(const ValueDict &values, Row &row) const
+{
+    if (!row.fits(this->column_attributes))
+        row.bind(this->column_attributes);
+    row.clear_text();
+    for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+    {
+        ValueDict::const_iterator it = values.find(this->column_names[col_num]);
+        if (it == values.end())
+            throw DbRelationError("don't know how to handle NULLs, defaults, etc.");
+        row.set(col_num, it->second);
+    }
+}
+
+// Just the given columns (all of them if column_names is nullptr or empty).
+ValueDict *DbRelation::to_value_dict(const Row &row, const ColumnNames *column_names) const
+{
+    ValueDict *values = new ValueDict();
+    if (column_names == nullptr || column_names->empty())
+    {
+        for (uint col_num = 0; col_num < this->column_names.size(); col_num++)
+            (*values)[this->column_names[col_num]] = row.get(col_num);
+        return values;
+    }
+    for (auto const &column_name : *column_names)
+    {
+        uint col_num = 0;
+        while (col_num < this->column_names.size() && this->column_names[col_num] != column_name)
+            col_num++;
+        if (col_num == this->column_names.size())
+        {
+            delete values;
+            throw DbRelationError("unknown column " + column_name);
+        }
+        (*values)[column_name] = row.get(col_num);
+    }
+    return values;
+}
+
+void Row::bind(const ColumnAttributes &column_attributes)
+{
+    this->fields.resize(column_attributes.size());
+    for (uint col_num = 0; col_num < column_attributes.size(); col_num++)
+    {
+        ColumnAttribute ca = column_attributes[col_num];
+        this->fields[col_num].data_type = ca.get_data_type();
+        this->fields[col_num].n = 0;
+        this->fields[col_num].size = 0;
+    }
+    this->text.clear();
+}
+
+bool Row::fits(const ColumnAttributes &column_attributes) const
+{
+    if (this->fields.size() != column_attributes.size())
+        return false;
+    for (uint col_num = 0; col_num < column_attributes.size(); col_num++)
+    {
+        ColumnAttribute ca = column_attributes[col_num];
+        if (this->fields[col_num].data_type != ca.get_data_type())
+            return false;
+    }
+    return true;
+}
+
+void Row::set_text(uint col_num, const char *data, u_int32_t size)
+{
+    this->fields[col_num].offset = this->text.size();
+    this->fields[col_num].size = size;
+    this->text.insert(this->text.end(), data, data + size);
+}
+
+Value Row::get(uint col_num) const
+{
+    Value value;
+    value.data_type = get_data_type(col_num);
+    if (value.data_type == ColumnAttribute::TEXT)
+        value.s = get_text(col_num);
+    else
+        value.n = get_int(col_num);
+    return value;
+}
+
+void Row::set(uint col_num, const Value &value)
+{
+    if (get_data_type(col_num) == ColumnAttribute::TEXT)
+        set_text(col_num, value.s.data(), value.s.length());
+    else
+        set_int(col_num, value.n);
+}
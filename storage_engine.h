@@ -11,6 +11,7 @@
 
 #include <exception>
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
@@ -26,8 +27,24 @@ extern DbEnv *_DB_ENV;
 typedef u_int16_t RecordID;
 typedef u_int32_t BlockID;
 typedef std::vector<RecordID> RecordIDs;
+typedef std::pair<BlockID, RecordID> Handle;
 typedef std::length_error DbBlockNoRoomError;
 
+/**
+ * @class RecordView - read-only window onto a record's bytes inside a block
+ * (no copy is made, so it is only valid while the block it came from is pinned)
+ */
+class RecordView
+{
+public:
+    RecordView() : data(nullptr), size(0) {}
+
+    RecordView(const char *data, u_int32_t size) : data(data), size(size) {}
+
+    const char *data;
+    u_int32_t size;
+};
+
 /**
  * @class DbBlock - abstract base class for blocks in our database files
  * (DbBlock's belong to DbFile's.)
@@ -35,22 +52,41 @@ typedef std::length_error DbBlockNoRoomError;
  * Methods for putting/getting records in blocks:
  * 	add(data)
  * 	get(record_id)
+ * 	view(record_id, record)
  * 	put(record_id, data)
  * 	del(record_id)
  * 	ids()
+ * 	next_id(record_id)
+ * Methods for records that have to leave their block (optional):
+ * 	forward(record_id, target)
+ * 	forwarded(record_id, target)
+ * 	add_moved(data)
  * Accessors:
  * 	get_block()
  * 	get_data()
  * 	get_block_id()
+ * 	get_free_space()
  */
 class DbBlock
 {
 public:
     /**
-     * our blocks are 4kB
+     * our blocks are 4kB unless the file says otherwise (see MAX_BLOCK_SZ)
      */
     static const uint BLOCK_SZ = 4096;
 
+    /**
+     * largest block a file may use (record offsets within a block are 16 bits)
+     */
+    static const uint MAX_BLOCK_SZ = 65536;
+
+    /**
+     * Whether a file may use blocks of this size: a power of two from BLOCK_SZ to MAX_BLOCK_SZ.
+     * @param block_sz  size asked for, in bytes
+     * @returns         true if it is one of the sizes we support
+     */
+    static bool is_valid_size(uint block_sz);
+
     /**
      * ctor/dtor (subclasses should handle the big-5)
      */
@@ -71,7 +107,17 @@ public:
      * @param record_id  which record to fetch
      * @returns          the data stored for the given record
      */
-    virtual Dbt *get(RecordID record_id) const = 0;
+    virtual Dbt *get(RecordID record_id) = 0;
+
+    /**
+     * Look at a record in place, without copying or allocating.
+     * A block that has to put the record together first (PaxPage) keeps one view at a time, so
+     * record is only good until the next view() of the same block; it is always gone once the block changes.
+     * @param record_id  which record to look at
+     * @param record     returned by reference: the record's bytes within this block
+     * @returns          false if the record has been deleted
+     */
+    virtual bool view(RecordID record_id, RecordView &record) = 0;
 
     /**
      * Change the data stored for a record in this block.
@@ -92,7 +138,64 @@ public:
      * Get all the record ids in this block (excluding deleted ones).
      * @returns  pointer to list of record ids (freed by caller)
      */
-    virtual RecordIDs *ids() const = 0;
+    virtual RecordIDs *ids() = 0;
+
+    /**
+     * Cursor-style walk over the record ids in this block (excluding deleted ones),
+     * without building a list. Start with record_id = 0.
+     * @param record_id  in: the previous record id, out: the next one
+     * @returns          false if there are no more records
+     */
+    virtual bool next_id(RecordID &record_id) = 0;
+
+    /**
+     * Replace a record with a stub saying where it lives now, so its RecordID stays good.
+     * The stub is not a record: view() says no, but next_id() still stops at it.
+     * @param record_id  which record moved
+     * @param target     where it went (a record added with add_moved())
+     * @throws           DbBlockNoRoomError if the block can't hold the stub, or doesn't do forwarding
+     */
+    virtual void forward(RecordID record_id, Handle target)
+    {
+        throw DbBlockNoRoomError("records in this block can't be moved");
+    }
+
+    /**
+     * Whether a record id holds a stub left by forward().
+     * @param record_id  which record to look at
+     * @param target     returned by reference: where the record lives now
+     * @returns          false if the record is here (or deleted)
+     */
+    virtual bool forwarded(RecordID record_id, Handle &target) { return false; }
+
+    /**
+     * Add a record that belongs to another block's stub. It can be viewed, put and deleted like
+     * any other record, but next_id() skips it, so a scan only meets it through its stub.
+     * @param data  the data to store
+     * @returns     the new RecordID
+     * @throws      DbBlockNoRoomError if insufficient room in the block, or the block doesn't do forwarding
+     */
+    virtual RecordID add_moved(const Dbt *data)
+    {
+        throw DbBlockNoRoomError("records in this block can't be moved");
+    }
+
+    /**
+     * Advance record_id to the next record added with add_moved() (start from 0).
+     * @param record_id  in: the previous record id, out: the next one
+     * @returns          false if there are no more
+     */
+    virtual bool next_moved(RecordID &record_id) { return false; }
+
+    /**
+     * Whether the block holds nothing at all: no records, stubs or moved records.
+     * @returns  true if the block is empty
+     */
+    virtual bool is_empty()
+    {
+        RecordID record_id = 0;
+        return !next_id(record_id);
+    }
 
     /**
      * Access the whole block's memory as a BerkeleyDB Dbt pointer.
@@ -112,13 +215,25 @@ public:
      */
     virtual BlockID get_block_id() { return block_id; }
 
+    /**
+     * Get the size of this block (set by the file it belongs to).
+     * @returns this block's size in bytes
+     */
+    virtual u_int32_t get_block_size() { return block.get_size(); }
+
+    /**
+     * How much room is left in this block for new records.
+     * @returns  number of bytes an add() can still use, counting the new record's own bookkeeping
+     */
+    virtual u_int32_t get_free_space() = 0;
+
 protected:
     Dbt block;
     BlockID block_id;
 };
 
 // convenience type alias
-typedef std::vector<BlockID> BlockIDs; // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<BlockID> BlockIDs; // for scans, use DbFile::next_block_id() instead
 
 /**
  * @class DbFile - abstract base class which represents a disk-based collection of DbBlocks
@@ -129,7 +244,10 @@ typedef std::vector<BlockID> BlockIDs; // FIXME: will need to turn this into an
  * 	get_new()
  *	get(block_id)
  *	put(block)
+ *	release(block)
  *	block_ids()
+ *	next_block_id(block_id)
+ *	prefetch(block_id, count)
  */
 class DbFile
 {
@@ -161,14 +279,14 @@ public:
 
     /**
      * Add a new block for this file.
-     * @returns  the newly appended block
+     * @returns  the newly appended block (pinned, hand back with release())
      */
     virtual DbBlock *get_new() = 0;
 
     /**
      * Get a specific block in this file.
      * @param block_id  which block to get
-     * @returns         pointer to the DbBlock (freed by caller)
+     * @returns         pointer to the DbBlock (pinned, hand back with release())
      */
     virtual DbBlock *get(BlockID block_id) = 0;
 
@@ -178,12 +296,34 @@ public:
      */
     virtual void put(DbBlock *block) = 0;
 
+    /**
+     * Give back a block obtained from get() or get_new().
+     * The block must not be used after it is released.
+     * @param block  block to unpin
+     */
+    virtual void release(DbBlock *block) = 0;
+
     /**
      * Get a list of all the valid BlockID's in the file
-     * FIXME - not a good long-term approach, but we'll do this until we put in iterators
+     * (scans should use next_block_id() rather than materializing this)
      * @returns  a pointer to vector of BlockIDs (freed by caller)
      */
-    virtual BlockIDs *block_ids() const = 0;
+    virtual BlockIDs *block_ids() = 0;
+
+    /**
+     * Cursor-style walk over the valid BlockID's in the file. Start with block_id = 0.
+     * @param block_id  in: the previous block id, out: the next one
+     * @returns         false if there are no more blocks
+     */
+    virtual bool next_block_id(BlockID &block_id) = 0;
+
+    /**
+     * Hint that a scan is about to get() some blocks in order, so their reads can start early.
+     * Doesn't wait for anything; files that can't say where their blocks are (HeapFile) ignore it.
+     * @param block_id  first block that will be needed
+     * @param count     how many blocks from there
+     */
+    virtual void prefetch(BlockID block_id, uint count) {}
 
 protected:
     std::string name; // filename (or part of it)
@@ -241,10 +381,87 @@ public:
 typedef std::string Identifier;
 typedef std::vector<Identifier> ColumnNames;
 typedef std::vector<ColumnAttribute> ColumnAttributes;
-typedef std::pair<BlockID, RecordID> Handle;
-typedef std::vector<Handle> Handles; // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<Handle> Handles; // for scans, use DbRelation::cursor() instead
 typedef std::map<Identifier, Value> ValueDict;
 typedef std::vector<ValueDict *> ValueDicts;
+typedef std::vector<std::pair<Handle, Handle>> Relocations; // (old handle, new handle) of each row that moved
+
+/**
+ * @class Row - one row's values by column number, laid out for a relation's columns
+ *
+ * INT and BOOLEAN values are kept in the field itself; a TEXT field points into one character
+ * buffer shared by the whole row. A Row that is refilled again and again (as in a scan) stops
+ * allocating once its buffer is big enough, unlike a ValueDict, which costs a tree node and a
+ * std::string per column every time.
+ */
+class Row
+{
+public:
+    Row() {}
+
+    explicit Row(const ColumnAttributes &column_attributes) { bind(column_attributes); }
+
+    /**
+     * Make this row fit a relation's columns. Values are left unset.
+     */
+    void bind(const ColumnAttributes &column_attributes);
+
+    /**
+     * Is this row already bound to columns of these types? Rows of the same width
+     * can still differ, so the width alone doesn't tell.
+     */
+    bool fits(const ColumnAttributes &column_attributes) const;
+
+    uint size() const { return fields.size(); }
+
+    ColumnAttribute::DataType get_data_type(uint col_num) const { return fields[col_num].data_type; }
+
+    int32_t get_int(uint col_num) const { return fields[col_num].n; }
+
+    bool get_boolean(uint col_num) const { return fields[col_num].n != 0; }
+
+    const char *get_text_data(uint col_num) const { return text.empty() ? "" : text.data() + fields[col_num].offset; }
+
+    u_int32_t get_text_size(uint col_num) const { return fields[col_num].size; }
+
+    std::string get_text(uint col_num) const { return std::string(get_text_data(col_num), get_text_size(col_num)); }
+
+    void set_int(uint col_num, int32_t n) { fields[col_num].n = n; }
+
+    void set_boolean(uint col_num, bool b) { fields[col_num].n = b; }
+
+    /**
+     * Copy a TEXT value into the row's buffer. Earlier text stays there until clear_text().
+     */
+    void set_text(uint col_num, const char *data, u_int32_t size);
+
+    /**
+     * Forget all TEXT values, so the buffer can be reused for the next row.
+     */
+    void clear_text() { text.clear(); }
+
+    /**
+     * Adapters to and from Value.
+     */
+    Value get(uint col_num) const;
+
+    void set(uint col_num, const Value &value);
+
+protected:
+    struct Field
+    {
+        ColumnAttribute::DataType data_type;
+        union
+        {
+            int32_t n;        // INT, BOOLEAN
+            u_int32_t offset; // TEXT: where it starts in text
+        };
+        u_int32_t size;       // TEXT: length
+    };
+
+    std::vector<Field> fields;
+    std::vector<char> text;
+};
 
 /**
  * @class DbRelationError - generic exception class for DbRelation
@@ -255,6 +472,38 @@ public:
     explicit DbRelationError(std::string s) : runtime_error(s) {}
 };
 
+/**
+ * @class DbRelationCursor - forward-only scan over the rows of a DbRelation
+ *
+ * Rows are found one at a time as the blocks are read, so a scan needs constant
+ * memory no matter how big the relation is, and the first row is available right away.
+ */
+class DbRelationCursor
+{
+public:
+    virtual ~DbRelationCursor() {}
+
+    /**
+     * Advance to the next qualifying row.
+     * @param handle  returned by reference: handle of the row
+     * @returns       false if there are no more rows
+     */
+    virtual bool next(Handle &handle) = 0;
+
+    /**
+     * Return values of the current row (only valid after next() returned true).
+     * @param column_names  list of column names to project (all columns if nullptr)
+     * @returns             dictionary of values from the row (freed by caller)
+     */
+    virtual ValueDict *project(const ColumnNames *column_names = nullptr) = 0;
+
+    /**
+     * Decode all columns of the current row into a Row bound to the relation's columns.
+     * @param row  returned by reference: the row's values
+     */
+    virtual void project(Row &row) = 0;
+};
+
 /**
  * @class DbRelation - top-level object handling a physical database relation
  *
@@ -267,12 +516,19 @@ public:
  * 	close()
  *
  *	insert(row)
+ *	insert_batch(rows)
+ *	project(handle, row)
  *	update(handle, new_values)
  *	del(handle)
  *	select()
  *	select(where)
+ *	select(where, parallelism)
+ *	cursor(where)
+ *	scan(where, column_names)
  *	project(handle)
  *	project(handle, column_names)
+ *	project_many(handles, column_names)
+ *	vacuum()
  */
 class DbRelation
 {
@@ -313,6 +569,12 @@ public:
      */
     virtual void close() = 0;
 
+    /**
+     * Write back whatever the table is holding in memory, so that another object opening it
+     * sees every change. The table stays open.
+     */
+    virtual void flush() {}
+
     /**
      * Execute: INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> )
      * @param row  a dictionary keyed by column names
@@ -320,6 +582,21 @@ public:
      */
     virtual Handle insert(const ValueDict *row) = 0;
 
+    /**
+     * Execute: INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> ), ...
+     * for a whole list of rows at once.
+     * @param rows  dictionaries keyed by column names
+     * @returns     a pointer to the handles of the new rows, in the same order (freed by caller)
+     */
+    virtual Handles *insert_batch(const ValueDicts &rows);
+
+    /**
+     * Same as insert(ValueDict), for a Row bound to our columns.
+     * @param row  values for every column, in column order
+     * @returns    a handle to the new row
+     */
+    virtual Handle insert(const Row &row);
+
     /**
      * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g., returned
@@ -350,6 +627,34 @@ public:
      */
     virtual Handles *select(const ValueDict *where) = 0;
 
+    /**
+     * Same as select(where), with the scan split among up to parallelism threads.
+     * Relations that can't scan in parallel just call select(where).
+     * @param where        where-clause predicates (nullptr for all rows)
+     * @param parallelism  degree of parallelism for this query (0 lets the relation choose)
+     * @returns            a pointer to a list of handles for qualifying rows, in the same order as select(where) (freed by caller)
+     */
+    virtual Handles *select(const ValueDict *where, uint parallelism);
+
+    /**
+     * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+     * but hand back the qualifying rows one at a time instead of as a list.
+     * @param where  where-clause predicates (nullptr for all rows)
+     * @returns      a cursor positioned before the first row (freed by caller)
+     */
+    virtual DbRelationCursor *cursor(const ValueDict *where = nullptr) = 0;
+
+    /**
+     * Conceptually, execute: SELECT <column_names> FROM <table_name> WHERE <where>
+     * in one pass, decoding each qualifying row as it is found instead of handing back handles.
+     * @param where         where-clause predicates (nullptr for all rows)
+     * @param column_names  list of column names to project (all columns if nullptr)
+     * @param parallelism   as for select(where, parallelism)
+     * @returns             a pointer to dictionaries of values, in the same order as select(where) (all freed by caller)
+     */
+    virtual ValueDicts *scan(const ValueDict *where = nullptr, const ColumnNames *column_names = nullptr,
+                             uint parallelism = 1);
+
     /**
      * Return a sequence of all values for handle (SELECT *).
      * @param handle  row to get values from
@@ -375,6 +680,37 @@ public:
      */
     virtual ValueDict *project(Handle handle, const ValueDict *column_names);
 
+    /**
+     * Same as project(handle), into a Row bound to our columns.
+     * @param handle  row to get values from
+     * @param row     returned by reference: every column's value, in column order
+     */
+    virtual void project(Handle handle, Row &row);
+
+    /**
+     * Same as project(handle, column_names) for each of handles.
+     * @param handles       rows to get values from
+     * @param column_names  list of column names to project (all columns if nullptr)
+     * @returns             a pointer to dictionaries of values, in the same order as handles (all freed by caller)
+     */
+    virtual ValueDicts *project_many(const Handles &handles, const ColumnNames *column_names = nullptr);
+
+    /**
+     * Pack the rows into as few blocks as possible and give the rest back.
+     * Rows may get new handles, so whatever keeps handles (the relation's indices) has to be told.
+     * Nothing else may use the relation until it returns.
+     * @returns  (old handle, new handle) of each row that moved, in old handle order (freed by caller)
+     * @throws   DbRelationError if the relation can't be vacuumed
+     */
+    virtual Relocations *vacuum() { throw DbRelationError("vacuum not supported"); }
+
+    /**
+     * Adapters between a ValueDict keyed by our column names and a Row bound to our columns.
+     */
+    virtual void to_row(const ValueDict &values, Row &row) const;
+
+    virtual ValueDict *to_value_dict(const Row &row, const ColumnNames *column_names = nullptr) const;
+
     /**
      * Accessor for column_names.
      * @returns column_names   list of column names for this relation, in order
@@ -0,0 +1,117 @@
+/**
+ * @file worker_pool.cpp - Implementation of WorkerPool.
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#include "worker_pool.h"
+#include <algorithm>
+#include <exception>
+
+WorkerPool::WorkerPool(uint size) : stopping(false)
+{
+    for (uint i = 0; i < size; i++)
+        this->workers.push_back(std::thread(&WorkerPool::work, this));
+}
+
+// Let the workers finish what is queued and wait for them.
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (auto &worker : this->workers)
+        worker.join();
+}
+
+// Queue the job for threads - 1 workers, run it here too, then take back the copies still queued and wait
+// until the rest have returned.
+void WorkerPool::run(uint threads, const std::function<void()> &job)
+{
+    uint helpers = std::min(std::max(threads, 1U) - 1, get_size());
+    std::mutex done_lock;
+    std::condition_variable done;
+    uint running = helpers;
+    std::exception_ptr error;
+
+    auto attempt = [&]()
+    {
+        try
+        {
+            job();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(done_lock);
+            if (!error)
+                error = std::current_exception();
+        }
+    };
+
+    if (helpers > 0)
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (uint i = 0; i < helpers; i++)
+            this->tasks.push_back(std::make_pair(&running, [&]()
+                                                 {
+                                                     attempt();
+                                                     std::lock_guard<std::mutex> guard(done_lock);
+                                                     if (--running == 0)
+                                                         done.notify_all();
+                                                 }));
+    }
+    this->wake.notify_all();
+    attempt();
+
+    uint withdrawn = 0;
+    if (helpers > 0)
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (auto it = this->tasks.begin(); it != this->tasks.end();)
+        {
+            if (it->first == &running)
+            {
+                it = this->tasks.erase(it);
+                withdrawn++;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    std::unique_lock<std::mutex> waiting(done_lock);
+    running -= withdrawn;
+    done.wait(waiting, [&]()
+              { return running == 0; });
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Sized once, the first time a query asks for it.
+WorkerPool &WorkerPool::shared()
+{
+    static WorkerPool pool(std::max(std::thread::hardware_concurrency(), 1U) - 1);
+    return pool;
+}
+
+// Take queued tasks until the pool is destroyed.
+void WorkerPool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->wake.wait(guard, [this]()
+                            { return this->stopping || !this->tasks.empty(); });
+            if (this->tasks.empty())
+                return;
+            task = std::move(this->tasks.front().second);
+            this->tasks.pop_front();
+        }
+        task();
+    }
+}
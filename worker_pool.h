@@ -0,0 +1,68 @@
+/**
+ * @file worker_pool.h - Threads kept around for running parts of a query at once.
+ * WorkerPool
+ *
+ * @author Zhicong Zeng
+ * @see "Seattle University, CPSC5300, Spring 2022"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class WorkerPool - fixed set of threads waiting for jobs
+ *
+ *      run() hands a job to some of the workers and runs it on the calling thread as well, so a
+        query never waits for a worker to be free before getting started. The job is expected to
+        take its own pieces of work (morsels) from a shared counter until there are none left. So
+        once the calling thread's copy returns there is nothing left to start, and any copy still
+        queued, because every worker was busy with another query, is taken back rather than waited for.
+ */
+class WorkerPool
+{
+public:
+    WorkerPool(uint size);
+
+    virtual ~WorkerPool();
+
+    WorkerPool(const WorkerPool &other) = delete;
+
+    WorkerPool(WorkerPool &&temp) = delete;
+
+    WorkerPool &operator=(const WorkerPool &other) = delete;
+
+    WorkerPool &operator=(WorkerPool &&temp) = delete;
+
+    /**
+     * Run job on up to threads threads at once, the calling thread being one of them, and wait for the ones
+     * that got started. Copies no worker picked up before the calling thread's copy returned are dropped.
+     * @param threads  degree of parallelism wanted (more than get_size() + 1 is cut down to that)
+     * @param job      what each thread runs
+     * @throws         the first exception thrown by the job on any of the threads
+     */
+    virtual void run(uint threads, const std::function<void()> &job);
+
+    /**
+     * Number of worker threads (not counting the ones calling run()).
+     */
+    uint get_size() const { return workers.size(); }
+
+    /**
+     * The pool shared by all queries, with a worker for each core after the first.
+     */
+    static WorkerPool &shared();
+
+protected:
+    std::vector<std::thread> workers;
+    std::deque<std::pair<const void *, std::function<void()>>> tasks; // (run() call that queued it, task)
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+
+    virtual void work();
+};